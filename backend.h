@@ -0,0 +1,58 @@
+/*
+ * ==========================
+ *   FILE: ./backend.h
+ * ==========================
+ * Purpose: The calls libsttyl makes on a tty, as a table of functions, so
+ *			that a tty need not be a local device. This header is private
+ *			to the library: programs using it only see sttyl.h.
+ *
+ * Outline: libsttyl.c has the local backend, which is open(), tcgetattr(),
+ *			tcsetattr() and the rest, and picks a backend once per call:
+ *			by the prefix of the name in sttyl_open(), then by the fd. A
+ *			backend answers for every fd it opened (owns()); all other fds
+ *			are local. Each call has the arguments, result, and errno of
+ *			the system call it stands for.
+ */
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include	<termios.h>
+#include	<sys/ioctl.h>
+
+struct backend_t {const char *prefix;					//names it opens
+				  int (*open)(const char *);
+				  int (*close)(int);
+				  int (*get)(int, struct termios *);		//tcgetattr()
+				  int (*set)(int, int, const struct termios *);
+				  int (*ioctl)(int, unsigned long, void *);
+				  int (*flush)(int, int);					//tcflush()
+				  int (*drain)(int);						//tcdrain()
+				  int (*owns)(int); };
+
+/* rfc2217.c: serial ports on a terminal server, "rfc2217://host:port" */
+extern const struct backend_t rfc2217_backend;
+
+/* speed_t codes and rates, from the bauds[] table in libsttyl.c */
+int sttyl_rate_of(speed_t);
+int sttyl_code_of(int, speed_t *);
+
+/*
+ * Linux termios2 lets a tty run at any rate, not just the B-constants: the
+ * speed bits are set to BOTHER and the rates go in c_ispeed and c_ospeed.
+ * The kernel struct is declared here, since <asm/termbits.h> clashes with
+ * <termios.h>.
+ */
+#if defined(__linux__) && defined(TCGETS2) && defined(CBAUDEX)
+#define HAVE_TERMIOS2
+#ifndef BOTHER
+#define BOTHER CBAUDEX
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+struct termios2 {tcflag_t c_iflag; tcflag_t c_oflag; tcflag_t c_cflag;
+				 tcflag_t c_lflag; cc_t c_line; cc_t c_cc[19];
+				 speed_t c_ispeed; speed_t c_ospeed; };
+#endif
+
+#endif
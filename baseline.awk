@@ -0,0 +1,46 @@
+#
+# baseline.awk -- compare sttyl-bench results with a saved baseline
+#
+# Usage: awk -v slack=25 -f baseline.awk check.baseline check.out
+#
+# Both files are sttyl-bench output: name, ops, ns per op, ops per second.
+# A file may hold several runs; the best of each is used, so a run slowed
+# by something else on the machine does not count.
+# For each benchmark in "names" (default parse, exec_show, exec_set: parse
+# throughput and invocations per second), prints the baseline and new ops
+# per second and the change, and exits 1 if any fell by more than slack
+# percent, or is missing from either file. Faster is never a failure;
+# "make baseline" records a new one.
+#
+
+BEGIN {
+	if (slack == "")
+		slack = 25
+	if (names == "")
+		names = "parse exec_show exec_set"
+	nwant = split(names, want, " ")
+	bad = 0
+}
+
+/^#/	{ next }
+
+FNR == NR	{ if ($4 + 0 > base[$1] + 0) base[$1] = $4; next }
+
+			{ if ($4 + 0 > now[$1] + 0) now[$1] = $4 }
+
+END {
+	for (i = 1; i <= nwant; i++) {
+		n = want[i]
+		if (!(n in base) || !(n in now) || base[n] <= 0) {
+			printf("FAIL baseline: no result for %s\n", n)
+			bad = 1
+			continue
+		}
+		change = (now[n] - base[n]) * 100 / base[n]
+		printf("%s\t%.0f\t%.0f\t%+.1f%%%s\n", n, base[n], now[n], change,
+			   change < -slack ? "\tFAIL" : "")
+		if (change < -slack)
+			bad = 1
+	}
+	exit bad
+}
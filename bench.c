@@ -0,0 +1,425 @@
+/*
+ * ==========================
+ *   FILE: ./bench.c
+ * ==========================
+ * Purpose: Measure how fast sttyl parses, applies, and shows settings, on
+ *			pseudo-terminals, so no serial hardware is needed.
+ *
+ * Outline: The program is linked with libsttyl, so the library calls can
+ *			be timed directly: sttyl_lookup() and sttyl_parse() for parsing,
+ *			sttyl_apply_delta() and sttyl_apply() for applying, and
+ *			sttyl_format() for the report. The program given on the command
+ *			line is also run end to end, on a pty, with posix_spawn().
+ *
+ * Usage:	./sttyl-bench [-n ptys] [-i iterations] [-x runs] [program]
+ *			make bench						-- ./sttyl, the defaults
+ *			make bench PROG=./sttyl-static	-- some other build
+ *
+ * Output:	One line per benchmark on stdout, tab-separated:
+ *			name, operations timed, nanoseconds per operation, operations
+ *			per second. Lines starting with '#' are comments (the column
+ *			names, and the setup).
+ */
+
+#define _GNU_SOURCE					//posix_openpt(), ptsname()
+
+/* INCLUDES */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<limits.h>
+#include	<time.h>
+#include	<spawn.h>
+#include	<sys/wait.h>
+#include	"sttyl.h"
+
+/* CONSTANTS */
+#define YES 1
+#define NO  0
+#define MAXPTYS 256
+#define EXEC_ARGS 3
+#define REPORT 8192
+#define MAXNAMES 512
+
+/* a pty pair: the master end is held by the harness, the slave is the tty */
+struct pty_t {int master; int slave; char name[PATH_MAX]; };
+
+/* the arguments parsed per round of the parse benchmark */
+static char *parse_list[] = {
+	"-echo", "icanon", "erase", "x", "kill", "y", "-ixon", "opost",
+	"9600", "ispeed", "4800", "cs8", "-parenb", "hupcl", NULL
+};
+
+/* FUNCTION PROTOTYPES */
+void die(const char *, const char *);
+void parse(char **, struct sttyl_delta *);
+int open_pty(struct pty_t *);
+void drain_pty(struct pty_t *);
+double now_ns();
+void report(char *, long, double);
+void bench_lookup(long);
+void bench_parse(long);
+void bench_apply(long);
+void bench_update(struct pty_t *, int, long, int);
+void bench_show(struct pty_t *, long);
+void bench_exec(struct pty_t *, char *, int, long);
+
+extern char **environ;
+static char *progname;			//used for error-reporting
+
+/*
+ *	main()
+ *	 Method: Open the ptys, then run each benchmark in turn and print its
+ *			 line. Nothing is written to the ptys that isn't read back.
+ *	 Return: 0 on success, 1 if the arguments are bad or a pty cannot be
+ *			 opened.
+ */
+int main(int ac, char *av[])
+{
+	struct pty_t ptys[MAXPTYS];
+	int nptys = 8, opt, i;
+	long iterations = 100000, runs = 500;
+	char *prog = "./sttyl";
+
+	progname = *av;									//for die()
+
+	while ( (opt = getopt(ac, av, "n:i:x:")) != -1 )
+	{
+		if (opt == 'n' && (nptys = atoi(optarg)) > 0 && nptys <= MAXPTYS)
+			continue;
+		if (opt == 'i' && (iterations = atol(optarg)) > 0)
+			continue;
+		if (opt == 'x' && (runs = atol(optarg)) > 0)
+			continue;
+		fprintf(stderr, "usage: %s [-n ptys] [-i iterations] [-x runs] "
+				"[program]\n", progname);
+		return 1;
+	}
+	if (optind < ac)
+		prog = av[optind];
+
+	for(i = 0; i < nptys; i++)
+		if (open_pty(&ptys[i]) == -1)
+			die(strerror(errno), "posix_openpt");
+
+	printf("# ptys %d, iterations %ld, runs %ld, program %s\n",
+		   nptys, iterations, runs, prog);
+	printf("# name\tops\tns_per_op\tops_per_sec\n");
+
+	bench_lookup(iterations);
+	bench_parse(iterations);
+	bench_apply(iterations);
+	bench_update(ptys, nptys, iterations / 10, NO);	//syscalls: fewer rounds
+	bench_update(ptys, nptys, iterations / 10, YES);
+	bench_show(ptys, iterations / 10);
+	bench_exec(ptys, prog, NO, runs);
+	bench_exec(ptys, prog, YES, runs);
+
+	for(i = 0; i < nptys; i++)
+	{
+		close(ptys[i].slave);
+		close(ptys[i].master);
+	}
+
+	return 0;
+}
+
+/*
+ *	die()
+ *	Purpose: Print a message to stderr and exit, as sttyl does.
+ *	  Input: err, what went wrong
+ *			 arg, what it went wrong with
+ */
+void die(const char *err, const char *arg)
+{
+	fprintf(stderr, "%s: %s `%s'\n", progname, err, arg);
+	exit(1);
+}
+
+/*
+ *	parse()
+ *	Purpose: Parse a NULL-terminated list of settings into a fresh delta.
+ *	  Input: av, the settings
+ *			 delta, the delta to fill in
+ *	 Errors: A bad setting is reported and exit 1.
+ */
+void parse(char **av, struct sttyl_delta *delta)
+{
+	struct sttyl_err err;
+	int n;
+
+	sttyl_init(delta);
+	for( ; *av; av++)
+	{
+		if ( (n = sttyl_parse(av, delta, &err)) == -1 )
+			die(err.msg, err.arg);
+		av += n;
+	}
+	return;
+}
+
+/*
+ *	open_pty()
+ *	Purpose: Open a new pseudo-terminal pair.
+ *	  Input: p, where to store the two fds and the slave name
+ *	 Return: 0 on success, or -1 with errno set.
+ *	   Note: The master is non-blocking, so drain_pty() can read whatever
+ *			 is there and stop.
+ */
+int open_pty(struct pty_t *p)
+{
+	char *name;
+
+	if ( (p->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK)) == -1 )
+		return -1;
+
+	if (grantpt(p->master) == -1 || unlockpt(p->master) == -1 ||
+		(name = ptsname(p->master)) == NULL)
+		return -1;
+
+	snprintf(p->name, PATH_MAX, "%s", name);
+	if ( (p->slave = open(p->name, O_RDWR | O_NOCTTY)) == -1 )
+		return -1;
+
+	return 0;
+}
+
+/*
+ *	drain_pty()
+ *	Purpose: Throw away any output waiting on the master side of a pty,
+ *			 so a program writing to the slave never blocks.
+ */
+void drain_pty(struct pty_t *p)
+{
+	char buf[BUFSIZ];
+
+	while (read(p->master, buf, BUFSIZ) > 0)
+		;
+	return;
+}
+
+/*
+ *	now_ns()
+ *	Purpose: Read the monotonic clock.
+ *	 Return: The time in nanoseconds, as a double.
+ */
+double now_ns()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/*
+ *	report()
+ *	Purpose: Print the result line for one benchmark.
+ *	  Input: name, the benchmark name
+ *			 ops, how many operations were timed
+ *			 ns, the total time they took
+ */
+void report(char *name, long ops, double ns)
+{
+	printf("%s\t%ld\t%.1f\t%.0f\n", name, ops, ns / ops, ops * 1e9 / ns);
+	fflush(stdout);
+	return;
+}
+
+/*
+ *	bench_lookup()
+ *	Purpose: Time sttyl_lookup() of option names.
+ *	  Input: n, the number of lookups
+ *	 Method: Cycle through every option name, so hits are spread over the
+ *			 whole index.
+ */
+void bench_lookup(long n)
+{
+	const char *names[MAXNAMES];
+	long i, found = 0;
+	int nnames;
+	double start;
+
+	for(nnames = 0; nnames < MAXNAMES &&
+		(names[nnames] = sttyl_option_name(nnames)) != NULL; nnames++)
+		;
+
+	start = now_ns();
+	for(i = 0; i < n; i++)
+		if (sttyl_lookup(names[i % nnames]) != 0)
+			found++;
+
+	report("lookup", n, now_ns() - start);
+	if (found != n)
+		die("lookup failed during", "bench_lookup");
+	return;
+}
+
+/*
+ *	bench_parse()
+ *	Purpose: Time sttyl_parse(), i.e. looking up and compiling a setting
+ *			 into a delta.
+ *	  Input: n, the number of rounds; each round parses the whole of
+ *			 parse_list[] into a fresh delta
+ *	 Output: The time per setting parsed (a name and its argument, if
+ *			 any, count as one).
+ */
+void bench_parse(long n)
+{
+	struct sttyl_delta delta;
+	struct sttyl_err err;
+	long i, ops = 0;
+	char **av;
+	double start = now_ns();
+
+	for(i = 0; i < n; i++)
+	{
+		sttyl_init(&delta);
+		for(av = parse_list; *av; av++, ops++)
+			av += sttyl_parse(av, &delta, &err);
+	}
+
+	report("parse", ops, now_ns() - start);
+	return;
+}
+
+/*
+ *	bench_apply()
+ *	Purpose: Time sttyl_apply_delta() on a termios struct in memory.
+ *	  Input: n, the number of applies
+ *	 Method: Two deltas that undo each other are applied in turn, so every
+ *			 apply changes the struct.
+ */
+void bench_apply(long n)
+{
+	struct sttyl_delta delta[2];
+	struct termios info;
+	long i;
+	char *on[] = {"echo", "icanon", "erase", "x", "9600", NULL};
+	char *off[] = {"-echo", "-icanon", "erase", "y", "4800", NULL};
+	double start;
+
+	parse(on, &delta[0]);
+	parse(off, &delta[1]);
+
+	memset(&info, 0, sizeof(info));
+	start = now_ns();
+	for(i = 0; i < n; i++)
+		sttyl_apply_delta(&delta[i & 1], &info);
+
+	report("apply", n, now_ns() - start);
+	if (info.c_cc[VERASE] != (n & 1 ? 'x' : 'y'))	//use the result
+		die("apply failed during", "bench_apply");
+	return;
+}
+
+/*
+ *	bench_update()
+ *	Purpose: Time sttyl_apply() across the ptys: tcgetattr(), the compare,
+ *			 and (if needed) tcsetattr().
+ *	  Input: ptys, nptys, the ptys to update, in turn
+ *			 n, the number of updates
+ *			 same, YES to apply the same delta every time (so all but the
+ *			 first are no-ops), NO to toggle echo, so every call writes
+ */
+void bench_update(struct pty_t *ptys, int nptys, long n, int same)
+{
+	struct sttyl_delta delta[2];
+	char *on[] = {"echo", NULL}, *off[] = {"-echo", NULL}, *step;
+	long i;
+	double start;
+
+	parse(on, &delta[0]);
+	parse(off, &delta[1]);
+
+	start = now_ns();
+	for(i = 0; i < n; i++)
+	{
+		struct sttyl_delta *d = &delta[same == YES ? 0 : (i / nptys) & 1];
+
+		if (sttyl_apply(ptys[i % nptys].slave, d, &step) == -1)
+			die(strerror(errno), ptys[i % nptys].name);
+	}
+
+	report(same == YES ? "update_noop" : "update", n, now_ns() - start);
+	return;
+}
+
+/*
+ *	bench_show()
+ *	Purpose: Time sttyl_format() formatting a report into a buffer.
+ *	  Input: ptys, the first pty is shown
+ *			 n, the number of reports
+ *	 Method: The report is formatted into the same buffer each time, and
+ *			 never written: once whole, and once with only the flags, which
+ *			 needs no ioctl() on the pty.
+ */
+void bench_show(struct pty_t *ptys, long n)
+{
+	static const int fields[] = {0, STTYL_F_FLAGS};
+	static char *names[] = {"show", "show_flags"};
+	struct termios info;
+	char buf[REPORT];
+	long i;
+	int f;
+	double start;
+
+	if (tcgetattr(ptys[0].slave, &info) == -1)
+		die(strerror(errno), ptys[0].name);
+
+	for(f = 0; f < 2; f++)
+	{
+		start = now_ns();
+		for(i = 0; i < n; i++)
+			if (sttyl_format(ptys[0].name, ptys[0].slave, &info,
+							 STTYL_HUMAN | fields[f], buf, REPORT) == -1)
+				die("could not get window size for", ptys[0].name);
+		report(names[f], n, now_ns() - start);
+	}
+	return;
+}
+
+/*
+ *	bench_exec()
+ *	Purpose: Time whole runs of a sttyl program, with a pty as its stdin
+ *			 and stdout.
+ *	  Input: ptys, the first pty is used, as a login would use one tty
+ *			 prog, the program to run
+ *			 set, YES to toggle echo on each run, NO to just show settings
+ *			 n, the number of runs
+ *	 Output: "exec_show" or "exec_set", per run. A run that fails is
+ *			 reported, and the benchmark stops.
+ */
+void bench_exec(struct pty_t *ptys, char *prog, int set, long n)
+{
+	posix_spawn_file_actions_t actions;
+	char *args[EXEC_ARGS] = {prog, NULL, NULL};
+	struct pty_t *p = &ptys[0];
+	long i;
+	int status;
+	pid_t pid;
+	double start = now_ns();
+
+	for(i = 0; i < n; i++)
+	{
+		if (set == YES)
+			args[1] = i & 1 ? "echo" : "-echo";		//a real write each run
+
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, p->slave, 0);
+		posix_spawn_file_actions_adddup2(&actions, p->slave, 1);
+
+		if (posix_spawn(&pid, prog, &actions, NULL, args, environ) != 0)
+			die("cannot run", prog);
+		posix_spawn_file_actions_destroy(&actions);
+
+		if (waitpid(pid, &status, 0) == -1 || status != 0)
+			die("run failed for", prog);
+		drain_pty(p);
+	}
+
+	report(set == YES ? "exec_set" : "exec_show", n, now_ns() - start);
+	return;
+}
@@ -0,0 +1,1380 @@
+/*
+ * ==========================
+ *   FILE: ./check.c
+ * ==========================
+ * Purpose: Test sttyl on pseudo-terminals, so no serial hardware (and no
+ *			course test script) is needed: every option, every special
+ *			character value, the error messages, and a fuzz of the parser.
+ *
+ * Outline: The program is linked with libsttyl, built with ASan and UBSan,
+ *			and asks the library what each setting should do to a tty:
+ *			sttyl_parse() and sttyl_apply_delta() on the settings it has.
+ *			Then it runs sttyl on a pty and compares what the pty has after
+ *			it, with tcgetattr(). A setting the pty driver itself will not
+ *			keep (a direct tcsetattr() of it does not take either) is
+ *			skipped, not failed. Each setting is also read back through
+ *			sttyl's report and -g, and fed back in.
+ *
+ *			A remote port is tested on a fake RFC 2217 server, a child
+ *			process on a loopback socket that checks each byte the library
+ *			sends it, and sends back canned replies.
+ *
+ *			The fuzz runs sttyl_parse(), sttyl_format(), and the rest on
+ *			random words in this process, under the sanitizers, and then
+ *			the command line itself, built the same way, on random words.
+ *			The words come from a seed, so a failing run can be repeated.
+ *
+ * Usage:	./sttyl-check [-f rounds] [-r runs] [-s seed] program [fuzzed]
+ *			make check						-- ./sttyl, then ./sttyl-asan
+ *
+ * Output:	"FAIL check: what" for each failure, with the words for sttyl
+ *			that caused it, then one line per check, tab-separated: name,
+ *			cases, failed, skipped. Lines starting with '#' are comments.
+ *			The exit status is 1 if anything failed.
+ */
+
+#define _GNU_SOURCE					//posix_openpt(), ptsname()
+
+/* INCLUDES */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stddef.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<limits.h>
+#include	<time.h>
+#include	<spawn.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<sys/wait.h>
+#include	<sys/stat.h>
+#include	<sys/socket.h>
+#include	<netinet/in.h>
+#include	<arpa/inet.h>
+#include	"sttyl.h"
+
+/* CONSTANTS */
+#define YES 1
+#define NO  0
+#define SKIP 2						//check_form(): the pty would not keep it
+#define MAXARGS 16					//words given to one run of sttyl
+#define OUTPUT 16384				//captured stdout or stderr of one run
+#define REPORT 8192
+#define MAXNAMES 512
+#define MAXWORDS 8					//fuzz: most words in one round
+#define WORDLEN 320					//fuzz: longest word, and then some
+#define SANITIZED 86				//exit status of a sanitizer report
+#define SERVER_WAIT 10000			//ms the fake server waits for the client
+#define PROF_HEAD 16				//profile files, as in sttyl.c: header,
+#define PROF_NAME 32				//and the name before each entry's delta
+
+/* a pty pair: the master end is held by the harness, the slave is the tty */
+struct pty_t {int master; int slave; char name[PATH_MAX]; };
+
+/* a run of sttyl: its exit status, and what it wrote */
+struct run_t {int status; char out[OUTPUT]; char err[OUTPUT]; };
+
+/* a check's tally, printed at the end */
+struct count_t {const char *name; int cases; int failed; int skipped; };
+
+/*
+ * The fake RFC 2217 server, for check_remote(): each step is the bytes it
+ * must be sent next, and then its reply, sent ms later. BYTES() gives a
+ * string literal and its length, as the bytes may include '\0'.
+ */
+struct step_t {const char *expect; int elen; const char *reply; int rlen;
+			   int ms; };
+#define BYTES(s)	s, (int) sizeof(s) - 1
+#define SB			"\xff\xfa\x2c"		//IAC SB COM-PORT-OPTION
+#define SE			"\xff\xf0"			//IAC SE
+#define WILL_COM	"\xff\xfb\x2c"
+#define GET			SB "\x01\x00\x00\x00\x00" SE SB "\x02\x00" SE \
+					SB "\x03\x00" SE SB "\x04\x00" SE SB "\x05\x00" SE \
+					SB "\x05\x0d" SE
+#define GOT			SB "\x65\x00\x00\x4b\x00" SE SB "\x66\x07" SE \
+					SB "\x67\x03" SE SB "\x68\x02" SE SB "\x69\x03" SE \
+					SB "\x69\x10" SE
+						//19200, cs7, even parity, cstopb, crtscts
+
+static struct step_t port_steps[] = {
+	{BYTES(WILL_COM GET),		BYTES("\xff\xfd\x2c" "\xff\xfb\x01" GOT), 0},
+	{BYTES("\xff\xfe\x01" SB "\x02\x08" SE),	BYTES(SB "\x66\x08" SE), 0},
+	{BYTES(SB "\x0c\x01" SE),	BYTES(SB "\x70\x01" SE), 0},
+	{BYTES(SB "\x05\x09" SE),	BYTES(SB "\x69\x09" SE), 0},
+	{BYTES(GET),				BYTES(GOT), 0},
+	{BYTES(SB "\x01\x00\x00\x25\x80" SE SB "\x05\x08" SE),
+								BYTES(SB "\x65\x00\x00\x25\x80" SE
+									  SB "\x69\x08" SE), 0},
+	{BYTES(SB "\x0a\x40" SE),	BYTES(SB "\x6e\x40" SE SB "\x6a\x20" SE), 0},
+	{BYTES(""),					BYTES(SB "\x6a\x60" SE), 200},
+	{BYTES(SB "\x0a\x00" SE),	BYTES(SB "\x6e\x00" SE), 0},
+	{BYTES(SB "\x0a\x40" SE),	BYTES(SB "\x6e\x40" SE SB "\x6a\x60" SE), 0},
+	{BYTES(SB "\x0a\x00" SE),	BYTES(SB "\x6e\x00" SE), 0},
+	{BYTES(SB "\x0c\x01" SE),	BYTES(SB "\x70\x01" SE), 0},
+	{BYTES(SB "\x02\x06" SE),	BYTES(SB "\x66\x06" SE), 0},
+};
+static struct step_t refuse_steps[] = {
+	{BYTES(WILL_COM GET),		BYTES("\xff\xfe\x2c"), 0},
+};
+static struct step_t silent_steps[] = {
+	{BYTES(WILL_COM GET),		BYTES(""), 0},
+};
+#define NSTEPS(a)	(int) (sizeof(a) / sizeof(a[0]))
+
+/*
+ * The old my_script.sh cases: sttyl with these words must fail with this
+ * message (or, with NULL, succeed), before it changes anything.
+ */
+struct error_t {char *args[6]; const char *msg; };
+static struct error_t errors[] = {
+	{{"foobar"},						"illegal argument `foobar'"},
+	{{"foo", "bar"},					"illegal argument `foo'"},
+	{{"erase"},							"missing argument to `erase'"},
+	{{"kill"},							"missing argument to `kill'"},
+	{{"erase", "foo"},					"invalid integer argument `foo'"},
+	{{"erase", "+m"},					"invalid integer argument `+m'"},
+	{{"erase", "^aa"},					"invalid integer argument `^aa'"},
+	{{"erase", "0x100"},				"invalid integer argument `0x100'"},
+	{{"ispeed"},						"missing argument to `ispeed'"},
+	{{"ospeed", "fast"},				"invalid integer argument `fast'"},
+	{{"-9600"},							"illegal argument `-9600'"},
+	{{"--when"},						"missing argument to `--when'"},
+	{{"--when", "later", "-echo"},		"invalid argument `later'"},
+	{{"--fields"},						"missing argument to `--fields'"},
+	{{"--fields", "flags,bogus"},		"invalid argument `flags,bogus'"},
+	{{"--batch"},						"missing argument to `--batch'"},
+	{{"--batch", "/dev/null", "-F", "/dev/null"},
+										"cannot be used with -F"},
+	{{"--snapshot"},					"missing argument to `--snapshot'"},
+	{{"--diff", "/etc/passwd"},			"not a snapshot file"},
+	{{"--diff", "/dev/null", "-echo"},	"cannot be used with settings"},
+	{{"-sane"},							"illegal argument `-sane'"},
+	{{"min", "256"},					"invalid integer argument `256'"},
+	{{"time", "^A"},					"invalid integer argument `^A'"},
+	{{"line", "x"},						"invalid integer argument `x'"},
+	{{"-line", "1"},					"illegal argument `-line'"},
+	{{"xmit_fifo_size", "1000000"},		"invalid integer argument"},
+	{{"--flush"},						"missing argument to `--flush'"},
+	{{"--flush", "all"},				"invalid argument `all'"},
+	{{"-F", "rfc2217://localhost"},		"Invalid argument"},
+	{{"-j", "0"},						"invalid argument `0'"},
+	{{"-j", "4x"},						"invalid argument `4x'"},
+	{{"-j", "99999999999999999999"},	"invalid argument"},
+	{{"--interval", "-5"},				"invalid argument `-5'"},
+	{{"--interval", "5s"},				"invalid argument `5s'"},
+	{{"--interval", "9999999"},			"invalid argument `9999999'"},
+	{{"erase", "^H", "kill", "0x15", "eof", "M-^D"},	NULL},
+	{{"cbreak", "-cbreak"},				NULL},
+};
+#define NERRORS (sizeof(errors) / sizeof(errors[0]))
+
+/* fuzz words that are not option names */
+static char *odd_words[] = {
+	"0", "1", "255", "256", "-1", "4800", "9600", "250000", "4294967296",
+	"99999999999999999999", "0x", "0x7f", "0xff", "0x100", "^", "^?", "^@",
+	"^-", "^Z", "^aa", "M-", "M-^", "M-^?", "M-x", "undef", "<undef>", "x",
+	"", "-", "--", "=", "0:0:0:0", "1:2:3:4:5", "::::", NULL
+};
+
+/* and, for the command line, its own options, less those that never end */
+static char *cli_words[] = {
+	"--verify", "--when", "now", "drain", "flush", "--fields", "flags",
+	"cchars,speed", "size,serial,queue", "--json", "-g", "--stats",
+	"--trace", "--flush", "in", "out", "both", "--drain", "-j", "3", NULL
+};
+
+/* FUNCTION PROTOTYPES */
+void die(const char *, const char *);
+int open_pty(struct pty_t *);
+void get(struct pty_t *, struct termios *);
+void put(struct pty_t *, const struct termios *);
+pid_t start(char *, char **, struct pty_t *, int *, int *);
+int run(char *, char **, struct pty_t *, struct run_t *);
+int wait_for(int, const char *, char *, size_t);
+void fail(struct count_t *, const char *, char **);
+int parse(char **, struct sttyl_delta *);
+void check_options(char *, struct pty_t *);
+int check_form(char *, struct pty_t *, char *, char *);
+void check_report(char *, struct pty_t *, char **, const struct termios *);
+void check_values(char *, struct pty_t *);
+int shown_value(const char *, const char *, char *, size_t);
+void check_errors(char *, struct pty_t *);
+void check_watch(char *, struct pty_t *);
+void check_daemon(char *, struct pty_t *);
+void check_remote();
+int remote_apply(int, char *, int, int, struct termios *);
+pid_t fake_server(const struct step_t *, int, char *, size_t);
+void serve(int, const struct step_t *, int);
+void fuzz_parse(long, unsigned int, struct pty_t *);
+void fuzz_cli(char *, long, unsigned int, struct pty_t *);
+char * fuzz_word(unsigned int *, char *, int);
+void tally(struct count_t *);
+
+extern char **environ;
+static char *progname;			//used for error-reporting
+static struct termios initial;	//what each test starts from
+static int failures = 0;		//in all checks
+static int nnames = 0;			//option names, from sttyl_option_name()
+static const char *names[MAXNAMES];
+static struct count_t opts = {"options", 0, 0, 0};	//check_options() etc.
+
+/*
+ *	main()
+ *	 Method: Open two ptys, remember the settings of the first, and run
+ *			 each check in turn; the first pty is put back to its settings
+ *			 before each case, and the second is where -g is replayed.
+ *	 Return: 0 if every check passed, 1 if any failed, or if the arguments
+ *			 are bad or a pty cannot be opened.
+ */
+int main(int ac, char *av[])
+{
+	struct pty_t ptys[2];
+	long rounds = 200000, runs = 200;
+	unsigned int seed = 1;
+	char *prog, *fuzzed;
+	int opt, i;
+
+	progname = *av;									//for die()
+
+	while ( (opt = getopt(ac, av, "f:r:s:")) != -1 )
+	{
+		if (opt == 'f' && (rounds = atol(optarg)) >= 0)
+			continue;
+		if (opt == 'r' && (runs = atol(optarg)) >= 0)
+			continue;
+		if (opt == 's')
+		{
+			seed = strtoul(optarg, NULL, 0);
+			continue;
+		}
+		fprintf(stderr, "usage: %s [-f rounds] [-r runs] [-s seed] program "
+				"[fuzzed]\n", progname);
+		return 1;
+	}
+	if (optind >= ac)
+		die("missing argument:", "program");
+	prog = av[optind];
+	fuzzed = optind + 1 < ac ? av[optind + 1] : prog;
+
+	for(i = 0; i < 2; i++)
+		if (open_pty(&ptys[i]) == -1)
+			die(strerror(errno), "posix_openpt");
+	get(&ptys[0], &initial);
+	while (nnames < MAXNAMES && (names[nnames] = sttyl_option_name(nnames)))
+		nnames++;
+
+	setenv("ASAN_OPTIONS", "exitcode=86:detect_leaks=0", 1);
+	setenv("UBSAN_OPTIONS", "exitcode=86:print_stacktrace=1", 1);
+
+	printf("# program %s, fuzzed %s, options %d, rounds %ld, runs %ld, "
+		   "seed %u\n", prog, fuzzed, nnames, rounds, runs, seed);
+	printf("# name\tcases\tfailed\tskipped\n");
+
+	check_options(prog, ptys);
+	check_values(prog, ptys);
+	check_errors(prog, ptys);
+	check_watch(prog, ptys);
+	check_daemon(prog, ptys);
+	check_remote();
+	fuzz_parse(rounds, seed, ptys);
+	fuzz_cli(fuzzed, runs, seed, ptys);
+
+	for(i = 0; i < 2; i++)
+	{
+		close(ptys[i].slave);
+		close(ptys[i].master);
+	}
+
+	return failures == 0 ? 0 : 1;
+}
+
+/*
+ *	die()
+ *	Purpose: Print a message to stderr and exit, as sttyl does.
+ *	  Input: err, what went wrong
+ *			 arg, what it went wrong with
+ */
+void die(const char *err, const char *arg)
+{
+	fprintf(stderr, "%s: %s `%s'\n", progname, err, arg);
+	exit(1);
+}
+
+/*
+ *	open_pty()
+ *	Purpose: Open a new pseudo-terminal pair, as bench.c does.
+ *	  Input: p, where to store the two fds and the slave name
+ *	 Return: 0 on success, or -1 with errno set.
+ */
+int open_pty(struct pty_t *p)
+{
+	char *name;
+
+	if ( (p->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK)) == -1 )
+		return -1;
+
+	if (grantpt(p->master) == -1 || unlockpt(p->master) == -1 ||
+		(name = ptsname(p->master)) == NULL)
+		return -1;
+
+	snprintf(p->name, PATH_MAX, "%s", name);
+	if ( (p->slave = open(p->name, O_RDWR | O_NOCTTY)) == -1 )
+		return -1;
+
+	return 0;
+}
+
+/*
+ *	get(), put()
+ *	Purpose: Read or write the settings of a pty, directly.
+ *	 Errors: A pty that cannot be read or written is reported, and exit 1;
+ *			 nothing after it could be trusted.
+ */
+void get(struct pty_t *p, struct termios *info)
+{
+	if (tcgetattr(p->slave, info) == -1)
+		die(strerror(errno), p->name);
+	return;
+}
+
+void put(struct pty_t *p, const struct termios *info)
+{
+	if (tcsetattr(p->slave, TCSANOW, info) == -1)
+		die(strerror(errno), p->name);
+	return;
+}
+
+/*
+ *	start()
+ *	Purpose: Start sttyl on a pty, with its output going to pipes.
+ *	  Input: prog, the program to run
+ *			 args, the words to give it, NULL-terminated
+ *			 p, the pty for its stdin (the device, if no -F is given)
+ *			 stdout_fd, stderr_fd, where to store the read ends of its pipes
+ *	 Return: Its pid.
+ */
+pid_t start(char *prog, char **args, struct pty_t *p, int *stdout_fd,
+			int *stderr_fd)
+{
+	posix_spawn_file_actions_t actions;
+	char *argv[MAXARGS + 2];
+	int out[2], err[2], i;
+	pid_t pid;
+
+	argv[0] = prog;
+	for(i = 0; i < MAXARGS && args[i] != NULL; i++)
+		argv[i + 1] = args[i];
+	argv[i + 1] = NULL;
+
+	if (pipe(out) == -1 || pipe(err) == -1)
+		die(strerror(errno), "pipe");
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, p->slave, 0);
+	posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+	posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+	posix_spawn_file_actions_addclose(&actions, out[0]);
+	posix_spawn_file_actions_addclose(&actions, err[0]);
+
+	if (posix_spawn(&pid, prog, &actions, NULL, argv, environ) != 0)
+		die("cannot run", prog);
+	posix_spawn_file_actions_destroy(&actions);
+	close(out[1]);
+	close(err[1]);
+
+	*stdout_fd = out[0];
+	*stderr_fd = err[0];
+	return pid;
+}
+
+/*
+ *	run()
+ *	Purpose: Run sttyl once, on a pty, and collect what it wrote.
+ *	  Input: prog, args, p, as for start()
+ *			 r, where to store the exit status and output
+ *	 Return: The raw status from waitpid().
+ *	   Note: The output is read after the program exits, so it must fit
+ *			 in the pipes (64K each on Linux); sttyl's reports and errors
+ *			 for one device are far smaller. Anything past OUTPUT bytes is
+ *			 dropped.
+ */
+int run(char *prog, char **args, struct pty_t *p, struct run_t *r)
+{
+	int out, err, n;
+	pid_t pid;
+
+	pid = start(prog, args, p, &out, &err);
+	if (waitpid(pid, &r->status, 0) == -1)
+		die(strerror(errno), prog);
+	n = read(out, r->out, OUTPUT - 1);
+	r->out[n > 0 ? n : 0] = '\0';
+	n = read(err, r->err, OUTPUT - 1);
+	r->err[n > 0 ? n : 0] = '\0';
+	close(out);
+	close(err);
+
+	return r->status;
+}
+
+/*
+ *	wait_for()
+ *	Purpose: Read a running program's output until it says something.
+ *	  Input: fd, the pipe from it
+ *			 want, the text to wait for
+ *			 buf, size, where to keep what was read, which is appended to
+ *			 and stays NUL-terminated; it should start empty
+ *	 Return: YES once want has been read, NO if it is not there after
+ *			 SERVER_WAIT ms of silence, or the program closes the pipe.
+ */
+int wait_for(int fd, const char *want, char *buf, size_t size)
+{
+	struct pollfd pfd = {fd, POLLIN, 0};
+	size_t have = strlen(buf);
+	ssize_t n;
+
+	while (strstr(buf, want) == NULL)
+	{
+		if (have + 1 >= size || poll(&pfd, 1, SERVER_WAIT) != 1 ||
+			(n = read(fd, buf + have, size - have - 1)) <= 0)
+			return NO;
+		have += n;
+		buf[have] = '\0';
+	}
+	return YES;
+}
+
+/*
+ *	fail()
+ *	Purpose: Report a failed case, with the words that were being tested.
+ *	  Input: c, the check it failed in
+ *			 why, what went wrong
+ *			 args, the words, NULL-terminated
+ */
+void fail(struct count_t *c, const char *why, char **args)
+{
+	printf("FAIL %s: %s:", c->name, why);
+	for( ; *args; args++)
+		printf(" '%s'", *args);
+	printf("\n");
+	c->failed++;
+	return;
+}
+
+/*
+ *	parse()
+ *	Purpose: Parse a NULL-terminated list of settings into a fresh delta.
+ *	 Return: 0, or -1 if any of them is not a setting.
+ */
+int parse(char **av, struct sttyl_delta *delta)
+{
+	struct sttyl_err err;
+	int n;
+
+	sttyl_init(delta);
+	for( ; *av; av++)
+	{
+		if ( (n = sttyl_parse(av, delta, &err)) == -1 )
+			return -1;
+		av += n;
+	}
+	return 0;
+}
+
+/*
+ *	check_options()
+ *	Purpose: Check every option sttyl knows, in every form it takes.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the two ptys
+ *	 Method: A flag or combination is set, and then negated if it can be.
+ *			 A special char is given ^X, or 5 for a count such as min, a
+ *			 speed 4800, and the line discipline 0 (N_TTY, which a pty has
+ *			 already). A pty is not a serial port, so the serial options
+ *			 must fail, cleanly, with status 1.
+ */
+void check_options(char *prog, struct pty_t *ptys)
+{
+	struct sttyl_delta delta;
+	struct run_t r;
+	char neg[WORDLEN], *args[5], *arg;
+	int i, kind, result;
+
+	for(i = 0; i < nnames; i++)
+	{
+		kind = sttyl_lookup(names[i]);
+		arg = kind == STTYL_CCHAR ? "^X" :
+			  kind == STTYL_ISPEED || kind == STTYL_OSPEED ? "4800" :
+			  kind == STTYL_LINE ? "0" : kind == STTYL_FIFO ? "16" : NULL;
+		args[0] = (char *) names[i];
+		args[1] = arg;
+		args[2] = NULL;
+		if (kind == STTYL_CCHAR && parse(args, &delta) == -1)
+			arg = "5";								//a count
+		opts.cases++;
+
+		if (kind == STTYL_LOWLAT || kind == STTYL_FIFO)
+		{
+			args[0] = "-F";
+			args[1] = ptys[0].name;
+			args[2] = (char *) names[i];
+			args[3] = arg;
+			args[4] = NULL;
+			run(prog, args, &ptys[0], &r);
+			if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 1 ||
+				strstr(r.err, "serial") == NULL)
+				fail(&opts, "a serial option did not fail on a pty", args);
+			continue;
+		}
+
+		result = check_form(prog, ptys, (char *) names[i], arg);
+		opts.skipped += result == SKIP;
+		if (result == SKIP)
+			printf("# skipped, the pty does not keep it: %s\n", names[i]);
+
+		snprintf(neg, WORDLEN, "-%s", names[i]);
+		args[0] = neg;
+		args[1] = NULL;
+		if ((kind == STTYL_FLAG || kind == STTYL_COMBO) &&
+			parse(args, &delta) == 0)
+		{
+			opts.cases++;
+			result = check_form(prog, ptys, neg, NULL);
+			opts.skipped += result == SKIP;
+			if (result == SKIP)
+				printf("# skipped, the pty does not keep it: %s\n", neg);
+		}
+	}
+
+	tally(&opts);
+	return;
+}
+
+/*
+ *	check_form()
+ *	Purpose: Check one setting: run sttyl with it, and compare the pty
+ *			 with what the library says it should have.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the two ptys
+ *			 word, arg, the setting, and its argument or NULL
+ *	 Return: YES if it passed, NO if it failed (and was reported), or SKIP
+ *			 if the pty driver does not keep it, or refuses it (EINVAL, for
+ *			 a cflag change on some kernels), when set directly as well.
+ *	 Method: Then -g is run on the pty, and its output given to sttyl on
+ *			 the other pty, which must end up the same; and the report
+ *			 must show the setting (see check_report()).
+ */
+int check_form(char *prog, struct pty_t *ptys, char *word, char *arg)
+{
+	struct sttyl_delta delta;
+	struct termios expected, actual, other;
+	struct run_t r;
+	char *args[] = {"-F", ptys[0].name, word, arg, NULL}, *saved;
+	char *setting[] = {word, arg, NULL};
+	int before = opts.failed;
+
+	put(&ptys[0], &initial);
+	if (parse(setting, &delta) == -1)
+		die("the library does not parse", word);
+	expected = initial;
+	sttyl_apply_delta(&delta, &expected);
+
+	if (run(prog, args, &ptys[0], &r) != 0)
+	{
+		if (tcsetattr(ptys[0].slave, TCSANOW, &expected) == -1)
+			return SKIP;							//the pty refuses it too
+		fail(&opts, "sttyl failed", setting);
+		return NO;
+	}
+	get(&ptys[0], &actual);
+	if (sttyl_same(&expected, &actual) == NO)
+	{
+		put(&ptys[0], &initial);					//would the pty keep it?
+		tcsetattr(ptys[0].slave, TCSANOW, &expected);
+		get(&ptys[0], &other);
+		if (sttyl_same(&other, &actual) == YES)
+			return SKIP;
+		fail(&opts, "the pty does not have the setting", setting);
+		return NO;
+	}
+
+	args[2] = "-g";
+	args[3] = NULL;
+	if (run(prog, args, &ptys[0], &r) != 0)
+	{
+		fail(&opts, "-g failed, after", setting);
+		return NO;
+	}
+	saved = strrchr(r.out, ' ');					//after "name ", if any
+	saved = saved == NULL ? r.out : saved + 1;
+	saved[strcspn(saved, "\n")] = '\0';
+	args[1] = ptys[1].name;
+	args[2] = saved;
+	if (run(prog, args, &ptys[1], &r) != 0)
+	{
+		fail(&opts, "the -g output was refused, after", setting);
+		return NO;
+	}
+	get(&ptys[1], &other);
+	if (sttyl_same(&other, &actual) == NO)
+	{
+		fail(&opts, "the -g output does not restore", setting);
+		return NO;
+	}
+
+	check_report(prog, ptys, setting, &actual);
+	return opts.failed == before ? YES : NO;
+}
+
+/*
+ *	check_report()
+ *	Purpose: Check that sttyl's report shows a setting just made.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the two ptys; the first has the setting
+ *			 setting, the word and its argument, if any
+ *			 actual, the settings of the first pty
+ *	 Method: A flag must be listed as " name " when set, and not when
+ *			 negated (a choice, e.g. cr2, has no "-cr2" form). A special
+ *			 char must be listed as " name = value;", and the value shown,
+ *			 given back to sttyl from the starting settings, must set the
+ *			 same. Combinations and speeds are not named in the report.
+ */
+void check_report(char *prog, struct pty_t *ptys, char **setting,
+				  const struct termios *actual)
+{
+	struct termios again;
+	struct run_t r;
+	char *args[] = {"-F", ptys[0].name, NULL, NULL, NULL}, find[WORDLEN];
+	char value[WORDLEN], *word = setting[0];
+	const char *name = word[0] == '-' ? word + 1 : word;
+	int kind = sttyl_lookup(name);
+
+	if (kind != STTYL_FLAG && kind != STTYL_CCHAR)
+		return;
+	if (run(prog, args, &ptys[0], &r) != 0)
+	{
+		fail(&opts, "the report failed, after", setting);
+		return;
+	}
+
+	snprintf(find, WORDLEN, " %s ", name);
+	if (kind == STTYL_FLAG && (strstr(r.out, find) != NULL) != (word == name))
+		fail(&opts, "the report does not show", setting);
+	if (kind != STTYL_CCHAR)
+		return;
+
+	if (shown_value(r.out, name, value, WORDLEN) == NO)
+	{
+		fail(&opts, "the report does not show", setting);
+		return;
+	}
+	put(&ptys[0], &initial);
+	args[2] = word;
+	args[3] = value;
+	if (run(prog, args, &ptys[0], &r) != 0)
+		fail(&opts, "the value shown is refused", args + 2);
+	get(&ptys[0], &again);
+	if (sttyl_same(&again, actual) == NO)
+		fail(&opts, "the value shown sets something else", args + 2);
+	return;
+}
+
+/*
+ *	check_values()
+ *	Purpose: Check that every value a special char can have is shown in a
+ *			 form that sets it again.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the first pty is used
+ *	 Method: Each of the 256 values is put in c_cc[VERASE] directly, the
+ *			 report read, and the value shown for erase given back to
+ *			 sttyl from a different value.
+ */
+void check_values(char *prog, struct pty_t *ptys)
+{
+	static struct count_t c = {"values", 0, 0, 0};
+	struct termios info;
+	struct run_t r;
+	char *args[] = {"-F", ptys[0].name, "erase", NULL, NULL};
+	char value[WORDLEN];
+	int v;
+
+	for(v = 0; v < 256; v++)
+	{
+		info = initial;
+		info.c_cc[VERASE] = v;
+		put(&ptys[0], &info);
+		c.cases++;
+		args[2] = NULL;										//the report
+		if (run(prog, args, &ptys[0], &r) != 0 ||
+			shown_value(r.out, "erase", value, WORDLEN) == NO)
+		{
+			fail(&c, "the report does not show erase", args);
+			continue;
+		}
+
+		info.c_cc[VERASE] = v ^ 1;
+		put(&ptys[0], &info);
+		args[2] = "erase";
+		args[3] = value;
+		if (run(prog, args, &ptys[0], &r) != 0)
+			fail(&c, "the value shown is refused", args + 2);
+		get(&ptys[0], &info);
+		if (info.c_cc[VERASE] != v)
+			fail(&c, "the value shown sets something else", args + 2);
+	}
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	shown_value()
+ *	Purpose: Find the value a report shows for a special char.
+ *	  Input: report, sttyl's output
+ *			 name, the special char
+ *			 value, size, where to copy the value
+ *	 Return: YES if it was found, otherwise NO.
+ *	   Note: The value runs to the next "; ", and may itself be ';'.
+ */
+int shown_value(const char *report, const char *name, char *value,
+				size_t size)
+{
+	char find[WORDLEN];
+	const char *start, *end;
+
+	snprintf(find, WORDLEN, " %s = ", name);
+	if ( (start = strstr(report, find)) == NULL )
+		return NO;
+	start += strlen(find);
+	if (*start == '\0' || (end = strstr(start + 1, "; ")) == NULL ||
+		(size_t) (end - start) >= size)
+		return NO;
+
+	memcpy(value, start, end - start);
+	value[end - start] = '\0';
+	return YES;
+}
+
+/*
+ *	check_errors()
+ *	Purpose: Check the messages for bad arguments, and a --batch trace.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the first pty is stdin
+ *	 Method: Each case in errors[] must exit with status 1 and the
+ *			 message, or 0 if it has none. Then three --batch lines for the
+ *			 one pty must open it once (see cache_open() in sttyl.c), but
+ *			 read it for each line, as the first two write it, and
+ *			 a profile source with a line too long for compile_profiles()
+ *			 must be refused, naming the line. Last, a -g state with a flag
+ *			 word of 33 bits, or a char of 9, must be refused whole, not
+ *			 cut down to fit, and a tab in a device name must be escaped
+ *			 by --json.
+ */
+void check_errors(char *prog, struct pty_t *ptys)
+{
+	static struct count_t c = {"errors", 0, 0, 0};
+	struct run_t r;
+	char lines[3 * PATH_MAX + 32], *open_count;
+	char *args[] = {"--trace", "--batch", lines, NULL}, out[sizeof(lines) + 8];
+	char *compile[] = {"--compile-profiles", lines, out, NULL};
+	char want[sizeof(lines) + 32], state[16 * (STTYL_NWORDS + NCCS)];
+	char *wide[] = {"-F", ptys[0].name, state, NULL};
+	char *use[] = {"--profile", "local", "-F", ptys[0].name, NULL};
+	char *json[] = {"--json", "-F", out, NULL};
+	int bad = -1;
+	size_t i;
+	int fd;
+
+	for(i = 0; i < NERRORS; i++)
+	{
+		c.cases++;
+		run(prog, errors[i].args, &ptys[0], &r);
+		if (errors[i].msg == NULL && r.status != 0)
+			fail(&c, "did not succeed", errors[i].args);
+		else if (errors[i].msg != NULL && (!WIFEXITED(r.status) ||
+				 WEXITSTATUS(r.status) != 1 ||
+				 strstr(r.err, errors[i].msg) == NULL))
+			fail(&c, errors[i].msg, errors[i].args);
+	}
+	put(&ptys[0], &initial);
+
+	snprintf(lines, sizeof(lines), "/tmp/sttyl-check.%d", (int) getpid());
+	if ( (fd = open(lines, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1 )
+		die(strerror(errno), lines);
+	dprintf(fd, "%s -echo\n%s echo\n%s\n", ptys[0].name, ptys[0].name,
+			ptys[0].name);
+	close(fd);
+	c.cases++;
+	run(prog, args, &ptys[0], &r);
+	unlink(lines);
+	open_count = strstr(r.err, "devices: open ");
+	if (open_count != NULL)
+		open_count = strchr(open_count, '(');		//"open 13.7us (1, max"
+	if (r.status != 0 || open_count == NULL || strncmp(open_count, "(1,", 3))
+		fail(&c, "--batch did not open the device just once", args);
+	c.cases++;
+	open_count = strstr(r.err, "devices: ");
+	if (open_count != NULL && (open_count = strstr(open_count, "tcgetattr")))
+		open_count = strchr(open_count, '(');
+	if (open_count == NULL || strncmp(open_count, "(3,", 3))
+		fail(&c, "--batch did not read the device again after writes", args);
+
+	snprintf(out, sizeof(out), "%s.bin", lines);
+	if ( (fd = open(lines, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1 )
+		die(strerror(errno), lines);
+	dprintf(fd, "# long\nmodem 9600");
+	for(i = 0; i < BUFSIZ; i++)
+		dprintf(fd, " cs8");
+	dprintf(fd, "\nlocal -hupcl\n");
+	close(fd);
+	c.cases++;
+	run(prog, compile, &ptys[0], &r);
+	unlink(lines);
+	unlink(out);
+	snprintf(want, sizeof(want), "%s:2: line longer than", lines);
+	if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 1 ||
+		strstr(r.err, want) == NULL)
+		fail(&c, "a profile line too long was not refused", compile);
+
+	for(i = 0; i < 2; i++)							//damaged entries
+	{
+		if ( (fd = open(lines, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1 )
+			die(strerror(errno), lines);
+		dprintf(fd, "local -hupcl erase ^H\n");
+		close(fd);
+		run(prog, compile, &ptys[0], &r);
+		unlink(lines);
+		if (r.status != 0 || (fd = open(out, O_WRONLY)) == -1)
+			die("cannot compile a profile file", out);
+		if (i == 0)									//no NUL in the name
+			for(bad = 0; bad < PROF_NAME; bad++)
+				pwrite(fd, "x", 1, PROF_HEAD + bad);
+		else										//more chars than c_cc[]
+		{
+			bad = NCCS + 1;
+			pwrite(fd, &bad, sizeof(bad), PROF_HEAD + PROF_NAME +
+				   offsetof(struct sttyl_delta, ncc));
+		}
+		close(fd);
+		c.cases++;
+		setenv("STTYL_PROFILES", out, 1);
+		run(prog, use, &ptys[0], &r);
+		unsetenv("STTYL_PROFILES");
+		unlink(out);
+		if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 1 ||
+			strstr(r.err, "not a compiled profile file for this") == NULL)
+			fail(&c, "a damaged profile file was not refused", use);
+	}
+	put(&ptys[0], &initial);
+
+	for(i = 0; i < 2; i++)
+	{
+		size_t n, j;
+
+		n = snprintf(state, sizeof(state), "%s", i == 0 ? "100000000" : "0");
+		for(j = 1; j < STTYL_NWORDS + NCCS; j++)
+			n += snprintf(state + n, sizeof(state) - n, ":%s",
+						  i == 1 && j == STTYL_NWORDS ? "100" : "0");
+		c.cases++;
+		run(prog, wide, &ptys[0], &r);
+		if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 1 ||
+			strstr(r.err, "invalid saved state") == NULL ||
+			strstr(r.err, state) == NULL)
+			fail(&c, "a state too wide for termios was not refused", wide);
+	}
+	put(&ptys[0], &initial);
+
+	snprintf(out, sizeof(out), "%s\ttty", lines);	//a control byte
+	if (symlink(ptys[0].name, out) == -1)
+		die(strerror(errno), out);
+	c.cases++;
+	run(prog, json, &ptys[0], &r);
+	unlink(out);
+	snprintf(want, sizeof(want), "{\"device\": \"%s\\u0009tty\"", lines);
+	if (r.status != 0 || strncmp(r.out, want, strlen(want)))
+		fail(&c, "a control byte in a --json name was not escaped", json);
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	check_watch()
+ *	Purpose: Check that --watch reports drift on a pty, and its return.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the first pty is watched
+ *	 Method: sttyl watches the pty for echo, which it has, with an
+ *			 --interval of 1; then echo is turned off from here, on the
+ *			 harness's own fd, which wakes nothing, so the next full check
+ *			 must report "drift: -echo". Turned back on, it must report
+ *			 "ok". sttyl is then killed with SIGTERM, which it does not
+ *			 catch.
+ */
+void check_watch(char *prog, struct pty_t *ptys)
+{
+	static struct count_t c = {"watch", 0, 0, 0};
+	struct termios info;
+	char *args[] = {"--watch", "--interval", "1", "-F", ptys[0].name, "echo",
+					NULL}, line[OUTPUT] = "", want[PATH_MAX + 32];
+	int out, err, status;
+	pid_t pid;
+
+	info = initial;
+	info.c_lflag |= ECHO;
+	put(&ptys[0], &info);
+	pid = start(prog, args, &ptys[0], &out, &err);
+	usleep(200000);									//its first full check
+
+	c.cases++;
+	info.c_lflag &= ~ECHO;
+	put(&ptys[0], &info);
+	snprintf(want, sizeof(want), "%s: drift: -echo\n", ptys[0].name);
+	if (wait_for(out, want, line, sizeof(line)) == NO)
+		fail(&c, "no drift reported", args);
+
+	c.cases++;
+	info.c_lflag |= ECHO;
+	put(&ptys[0], &info);
+	snprintf(want, sizeof(want), "%s: ok\n", ptys[0].name);
+	if (wait_for(out, want, line, sizeof(line)) == NO)
+		fail(&c, "the return was not reported", args);
+
+	kill(pid, SIGTERM);
+	if (waitpid(pid, &status, 0) == -1 || !WIFSIGNALED(status) ||
+		WTERMSIG(status) != SIGTERM)
+		fail(&c, "it did not end on SIGTERM", args);
+	if (c.failed > 0)
+		printf("# watch wrote: %s", line);
+	close(out);
+	close(err);
+	put(&ptys[0], &initial);
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	check_daemon()
+ *	Purpose: Check that --daemon configures a device that appears, and
+ *			 stops cleanly.
+ *	  Input: prog, the sttyl program
+ *			 ptys, the first pty is the device
+ *	 Method: The daemon watches "port*" in a new directory for -echo. A
+ *			 symlink to the pty is made there, as udev would make one, and
+ *			 the daemon must log that it configured it, and the pty have
+ *			 echo off. On SIGTERM it must exit with status 0.
+ */
+void check_daemon(char *prog, struct pty_t *ptys)
+{
+	static struct count_t c = {"daemon", 0, 0, 0};
+	struct termios info;
+	char dir[64], pattern[96], port[96], want[128], line[OUTPUT] = "";
+	char *args[] = {"--daemon", "-F", pattern, "-echo", NULL};
+	int out, err, status;
+	pid_t pid;
+
+	snprintf(dir, sizeof(dir), "/tmp/sttyl-check.%d.d", (int) getpid());
+	snprintf(pattern, sizeof(pattern), "%s/port*", dir);
+	snprintf(port, sizeof(port), "%s/port0", dir);
+	if (mkdir(dir, 0700) == -1)
+		die(strerror(errno), dir);
+	info = initial;
+	info.c_lflag |= ECHO;
+	put(&ptys[0], &info);
+	pid = start(prog, args, &ptys[0], &out, &err);
+	usleep(200000);									//its inotify watch
+
+	c.cases++;
+	if (symlink(ptys[0].name, port) == -1)
+		die(strerror(errno), port);
+	snprintf(want, sizeof(want), "configured %s\n", port);
+	if (wait_for(err, want, line, sizeof(line)) == NO)
+		fail(&c, "the new device was not configured", args);
+	get(&ptys[0], &info);
+	if (info.c_lflag & ECHO)
+		fail(&c, "the new device does not have the settings", args);
+
+	c.cases++;
+	kill(pid, SIGTERM);
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+		WEXITSTATUS(status) != 0)
+		fail(&c, "it did not exit 0 on SIGTERM", args);
+	if (c.failed > 0)
+		printf("# daemon wrote: %s", line);
+	close(out);
+	close(err);
+	unlink(port);
+	rmdir(dir);
+	put(&ptys[0], &initial);
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	check_remote()
+ *	Purpose: Check the RFC 2217 backend, on a fake server.
+ *	 Method: One connection reads the settings, sets cs8, flushes, hangs
+ *			 up with B0 and reads them again, sets 9600, and drains; each
+ *			 call must send the server exactly the commands for what it
+ *			 changes (see port_steps[]), and read its replies back. The
+ *			 drain is only done when a line state notification says the
+ *			 transmitter is empty, which comes 200ms after one saying it is
+ *			 not. Last, cs6 with TCSAFLUSH must drain, purge the input, and
+ *			 only then send it. Then a server that refuses COM-PORT-OPTION
+ *			 must give EPROTONOSUPPORT, and one that never replies ETIMEDOUT.
+ */
+void check_remote()
+{
+	static struct count_t c = {"remote", 0, 0, 0};
+	struct termios info;
+	struct timespec t0, t1;
+	struct sttyl_delta delta;
+	char name[64], *what[] = {name, NULL}, *cs6[] = {"cs6", NULL}, *step;
+	int fd, status;
+	pid_t pid;
+
+	pid = fake_server(port_steps, NSTEPS(port_steps), name, sizeof(name));
+	if ( (fd = sttyl_open(name)) == -1 )
+		die(strerror(errno), name);
+
+	c.cases++;
+	if (sttyl_get(fd, &info) == -1 || cfgetospeed(&info) != B19200 ||
+		(info.c_cflag & (CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS)) !=
+		(CS7 | PARENB | CSTOPB | CRTSCTS))
+		fail(&c, "the settings read are not the server's", what);
+	c.cases++;
+	if (remote_apply(fd, "cs8", -1, NO, &info) != YES ||
+		(info.c_cflag & CSIZE) != CS8)
+		fail(&c, "cs8 was not set", what);
+	c.cases++;
+	if (remote_apply(fd, NULL, TCIFLUSH, NO, &info) != NO)
+		fail(&c, "the input was not purged", what);
+	c.cases++;
+	if (remote_apply(fd, "0", -1, NO, &info) != YES ||
+		sttyl_get(fd, &info) == -1 || cfgetospeed(&info) != B0)
+		fail(&c, "B0 did not hang up", what);
+	c.cases++;
+	if (remote_apply(fd, "9600", -1, NO, &info) != YES ||
+		cfgetospeed(&info) != B9600)
+		fail(&c, "9600 did not set the rate and DTR", what);
+	c.cases++;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (remote_apply(fd, NULL, -1, YES, &info) != NO)
+		fail(&c, "the drain failed", what);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if ((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000
+		< 150)
+		fail(&c, "the drain did not wait for the line", what);
+	c.cases++;
+	parse(cs6, &delta);
+	delta.when = TCSAFLUSH;
+	if (sttyl_apply_from(fd, &delta, &info, &step) != YES)
+		fail(&c, "cs6 was not set after a drain and a purge", what);
+	sttyl_close(fd);
+	if (waitpid(pid, &status, 0) == -1 || status != 0)
+		fail(&c, "the server was not sent what it should be", what);
+
+	c.cases++;
+	pid = fake_server(refuse_steps, NSTEPS(refuse_steps), name, sizeof(name));
+	if ( (fd = sttyl_open(name)) == -1 )
+		die(strerror(errno), name);
+	if (sttyl_get(fd, &info) != -1 || errno != EPROTONOSUPPORT)
+		fail(&c, "a refusal of COM-PORT-OPTION was not an error", what);
+	sttyl_close(fd);
+	if (waitpid(pid, &status, 0) == -1 || status != 0)
+		fail(&c, "the server was not sent what it should be", what);
+
+	c.cases++;
+	pid = fake_server(silent_steps, NSTEPS(silent_steps), name, sizeof(name));
+	if ( (fd = sttyl_open(name)) == -1 )
+		die(strerror(errno), name);
+	if (sttyl_get(fd, &info) != -1 || errno != ETIMEDOUT)
+		fail(&c, "a silent server did not time out", what);
+	sttyl_close(fd);
+	if (waitpid(pid, &status, 0) == -1 || status != 0)
+		fail(&c, "the server was not sent what it should be", what);
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	remote_apply()
+ *	Purpose: Apply one setting, and the queue actions, to a remote port.
+ *	  Input: fd, the port
+ *			 word, the setting, or NULL for none
+ *			 flush, drain, for the delta
+ *			 info, its settings, updated as by sttyl_apply_from()
+ *	 Return: What sttyl_apply_from() returns.
+ */
+int remote_apply(int fd, char *word, int flush, int drain,
+				 struct termios *info)
+{
+	struct sttyl_delta delta;
+	char *setting[] = {word, NULL}, *step;
+
+	if (parse(setting, &delta) == -1)
+		die("the library does not parse", word);
+	delta.flush = flush;
+	delta.drain = drain;
+	return sttyl_apply_from(fd, &delta, info, &step);
+}
+
+/*
+ *	fake_server()
+ *	Purpose: Start a fake RFC 2217 server, for one connection.
+ *	  Input: steps, n, what it is to be sent, and reply
+ *			 name, size, where to store the port's name for sttyl_open()
+ *	 Return: The pid of the server, which exits 0 if it was sent just what
+ *			 the steps say, and 1 if not, after printing what it was sent.
+ */
+pid_t fake_server(const struct step_t *steps, int n, char *name, size_t size)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int listener;
+	pid_t pid;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);	//any free port
+	if ((listener = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+		listen(listener, 1) == -1 ||
+		getsockname(listener, (struct sockaddr *) &addr, &len) == -1)
+		die(strerror(errno), "fake server");
+	snprintf(name, size, "rfc2217://127.0.0.1:%d", ntohs(addr.sin_port));
+
+	fflush(stdout);									//not twice
+	if ( (pid = fork()) == -1 )
+		die(strerror(errno), "fork");
+	if (pid == 0)
+		serve(listener, steps, n);
+	close(listener);
+	return pid;
+}
+
+/*
+ *	serve()
+ *	Purpose: Be the fake server: take one connection, and go through the
+ *			 steps on it.
+ *	  Input: listener, the listening socket
+ *			 steps, n, as for fake_server()
+ *	 Method: Each step reads just as many bytes as it expects, so a client
+ *			 that sends more shows as a mismatch in the next step, or at the
+ *			 end, when nothing more may come before the client closes. The
+ *			 reads give up after SERVER_WAIT ms.
+ */
+void serve(int listener, const struct step_t *steps, int n)
+{
+	struct pollfd pfd;
+	char buf[256];
+	int conn, i, have, got;
+
+	if ( (conn = accept(listener, NULL, NULL)) == -1 )
+		_exit(1);
+	pfd.fd = conn;
+	pfd.events = POLLIN;
+
+	for(i = 0; i <= n; i++)
+	{
+		have = 0;
+		got = 1;
+		while ((i == n || have < steps[i].elen) && got > 0 &&
+			   (size_t) have < sizeof(buf) &&
+			   poll(&pfd, 1, SERVER_WAIT) == 1 &&
+			   (got = read(conn, buf + have, sizeof(buf) - have)) > 0)
+			have += got;
+		if (i == n && have == 0 && got == 0)		//the client hung up
+			_exit(0);
+		if (i == n || have != steps[i].elen ||
+			memcmp(buf, steps[i].expect, have) != 0)
+		{
+			printf("# fake server, step %d of %d, sent %d bytes:", i + 1, n,
+				   have);
+			for(got = 0; got < have; got++)
+				printf(" %02x", (unsigned char) buf[got]);
+			printf("\n");
+			fflush(stdout);
+			_exit(1);
+		}
+
+		usleep(steps[i].ms * 1000);
+		if (write(conn, steps[i].reply, steps[i].rlen) != steps[i].rlen)
+			_exit(1);
+	}
+	_exit(1);										//not reached
+}
+
+/*
+ *	fuzz_parse()
+ *	Purpose: Run the library on random words, under the sanitizers.
+ *	  Input: rounds, how many lists of words to try
+ *			 seed, for rand_r()
+ *			 ptys, the first pty is given to the reports
+ *	 Method: Each round parses up to MAXWORDS random words into a delta,
+ *			 as sttyl does, and checks what sttyl_parse() returns: -1 with
+ *			 a message, or how many words it took, which must be there. The
+ *			 delta is applied, merged, and the result formatted in a random
+ *			 format into a buffer of random size, which must be terminated
+ *			 and as long as sttyl_format() says, up to its size. Memory
+ *			 errors and undefined behaviour are the sanitizers' to catch.
+ */
+void fuzz_parse(long rounds, unsigned int seed, struct pty_t *ptys)
+{
+	static struct count_t c = {"fuzz_parse", 0, 0, 0};
+	static const int formats[] = {STTYL_HUMAN, STTYL_SAVE, STTYL_JSON};
+	struct sttyl_delta delta, merged;
+	struct sttyl_err err;
+	struct termios info, other;
+	char words[MAXWORDS][WORDLEN], *av[MAXWORDS + 1], buf[REPORT];
+	long i;
+	int j, n, nwords, format, len;
+	size_t size;
+
+	memset(&info, 0, sizeof(info));
+	sttyl_init(&merged);
+	for(i = 0; i < rounds; i++)
+	{
+		nwords = 1 + rand_r(&seed) % MAXWORDS;
+		for(j = 0; j < nwords; j++)
+			av[j] = fuzz_word(&seed, words[j], NO);
+		av[nwords] = NULL;
+
+		c.cases++;
+		sttyl_init(&delta);
+		for(j = 0; j < nwords; j++)
+		{
+			if ( (n = sttyl_parse(av + j, &delta, &err)) == -1 )
+			{
+				if (err.msg == NULL)
+					fail(&c, "no message for an error", av);
+				break;
+			}
+			if (n < 0 || j + n >= nwords)
+				fail(&c, "more words taken than given", av);
+			j += n;
+		}
+
+		sttyl_merge(&merged, &delta);
+		other = info;
+		sttyl_apply_delta(&delta, &info);
+		sttyl_apply_delta(&merged, &other);
+
+		format = formats[rand_r(&seed) % 3] | (rand_r(&seed) & STTYL_F_ALL) |
+				 (rand_r(&seed) & 1 ? STTYL_LABEL : 0);
+		size = rand_r(&seed) % REPORT;
+		len = i & 1 ? sttyl_format(ptys[0].name, ptys[0].slave, &info,
+								   format, buf, size) :
+					  sttyl_format_diff(ptys[0].slave, &info, &other, buf,
+										size);
+		if (size > 0 && len >= 0 && strlen(buf) != ((size_t) len < size ?
+			(size_t) len : size - 1))
+			fail(&c, "a report is not the length returned", av);
+	}
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	fuzz_cli()
+ *	Purpose: Run the command line on random words, under the sanitizers.
+ *	  Input: prog, sttyl built with ASan and UBSan
+ *			 runs, how many runs
+ *			 seed, for rand_r()
+ *			 ptys, the first pty is the device
+ *	 Method: Each run is "-F pty" and random words, with sttyl's own
+ *			 options among them. It must exit with 0 or 1; a signal, or a
+ *			 sanitizer report (exit status SANITIZED, set in main()),
+ *			 fails, and the sanitizer's output is printed.
+ */
+void fuzz_cli(char *prog, long runs, unsigned int seed, struct pty_t *ptys)
+{
+	static struct count_t c = {"fuzz_cli", 0, 0, 0};
+	char words[MAXWORDS][WORDLEN], *args[MAXWORDS + 3];
+	static struct run_t r;
+	long i;
+	int j, nwords;
+
+	args[0] = "-F";
+	args[1] = ptys[0].name;
+	for(i = 0; i < runs; i++)
+	{
+		nwords = 1 + rand_r(&seed) % MAXWORDS;
+		for(j = 0; j < nwords; j++)
+			args[j + 2] = fuzz_word(&seed, words[j], YES);
+		args[nwords + 2] = NULL;
+
+		c.cases++;
+		put(&ptys[0], &initial);
+		run(prog, args, &ptys[0], &r);
+		if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) > 1)
+		{
+			fail(&c, WIFEXITED(r.status) ? "sanitizer report" : "signal",
+				 args);
+			printf("%s", r.err);
+		}
+	}
+	put(&ptys[0], &initial);
+
+	tally(&c);
+	return;
+}
+
+/*
+ *	fuzz_word()
+ *	Purpose: Make one random word for the fuzz.
+ *	  Input: seed, for rand_r()
+ *			 word, space for it, WORDLEN bytes
+ *			 cli, YES to include sttyl's own options
+ *	 Return: The word: an option name, negated or not, one of odd_words[],
+ *			 one of cli_words[], a run of random bytes, or a long word.
+ */
+char * fuzz_word(unsigned int *seed, char *word, int cli)
+{
+	int i, n, kind = rand_r(seed) % (cli == YES ? 7 : 6);
+
+	switch (kind)
+	{
+		case 0:
+			return (char *) names[rand_r(seed) % nnames];
+		case 1:
+			snprintf(word, WORDLEN, "-%s", names[rand_r(seed) % nnames]);
+			return word;
+		case 2:
+			for(n = 0; odd_words[n]; n++)
+				;
+			return odd_words[rand_r(seed) % n];
+		case 3:
+			n = 1 + rand_r(seed) % 12;
+			for(i = 0; i < n; i++)
+				word[i] = 1 + rand_r(seed) % 255;
+			word[n] = '\0';
+			return word;
+		case 4:
+			n = 256 + rand_r(seed) % 32;
+			memset(word, "a9^-"[rand_r(seed) % 4], n);
+			word[n] = '\0';
+			return word;
+		case 5:
+			snprintf(word, WORDLEN, "%d", rand_r(seed) - RAND_MAX / 2);
+			return word;
+		default:
+			for(n = 0; cli_words[n]; n++)
+				;
+			return cli_words[rand_r(seed) % n];
+	}
+}
+
+/*
+ *	tally()
+ *	Purpose: Print the result line for one check, and count its failures.
+ */
+void tally(struct count_t *c)
+{
+	printf("%s\t%d\t%d\t%d\n", c->name, c->cases, c->failed, c->skipped);
+	fflush(stdout);
+	failures += c->failed;
+	return;
+}
@@ -0,0 +1,373 @@
+#
+# mktables.awk -- generate sttyl_tab.h from sttyl.def
+#
+# Usage: LC_ALL=C awk -f mktables.awk sttyl.def > sttyl_tab.h
+#
+# Emits an enum of table positions (F_name, C_name), table[], cchars[] and
+# bauds[] in definition order, and options[] sorted in strcmp() order,
+# with opt_hash[], a hash index of it for lookup(). flag_lines() is the
+# flags report, written out flag by flag with constant masks, so nothing
+# is looked up in table[] to show them. combos[] holds each combination
+# setting as a finished delta: its flags are folded into set and clear
+# masks, as delta_flag() would, and its chars into patches, all as
+# constant expressions. Then the two
+# 256-entry tables for special characters, which do not depend on
+# sttyl.def: char_names[], how each value is shown, and caret_codes[], the
+# value of "^X" for each X, or -1.
+# Each entry is guarded by #if on its constants; the enum members carry the
+# same guard, so skipped entries leave no holes in any of the arrays.
+#
+
+function guard(a, b)
+{
+	if (b == "" || a == b)
+		return "#ifdef " a
+	return "#if defined(" a ") && defined(" b ")"
+}
+
+/^[ \t]*(#|$)/	{ next }
+
+/^[ \t]/ && cont != ""	{ cotext[cont] = cotext[cont] " " $0; next }
+
+{ cont = "" }
+
+$1 != "baud" && $2 in kind	{
+	printf("%s:%d: duplicate name `%s'\n", FILENAME, NR, $2) > "/dev/stderr"
+	status = 1
+	exit 1
+}
+
+$1 == "cchar"	{
+	nc++; cname[nc] = $2; cidx[nc] = $3; cnum[nc] = ($4 == "num")
+	kind[$2] = "OPT_CCHAR"; ref[$2] = "C_" $2; grd[$2] = guard($3)
+	cpos[$2] = nc
+	next
+}
+
+$1 == "combo"	{
+	base = $2; sub(/^-/, "", base)
+	if (base in kind && kind[base] != "OPT_COMBO" || $2 in cotext)
+		fail("duplicate name `" $2 "'")
+	cotext[$2] = $0; sub(/^[ \t]*combo[ \t]+[^ \t]+/, "", cotext[$2])
+	cont = $2										# more may follow
+	if (!(base in kind))
+	{
+		nk++; kname[nk] = base
+		kind[base] = "OPT_COMBO"; ref[base] = "K_" base; grd[base] = "#if 1"
+	}
+	next
+}
+
+$1 == "baud"	{
+	nb++; brate[nb] = $2; bcode[nb] = $3
+	next
+}
+
+$1 == "word"	{
+	kind[$2] = $3; ref[$2] = 0; grd[$2] = "#if 1"
+	next
+}
+
+$1 ~ /^[iocl]flag$/	{
+	nf++; fname[nf] = $2; ftype[nf] = $1; fflag[nf] = $3
+	fmask[nf] = (NF > 3) ? $4 : 0
+	kind[$2] = "OPT_FLAG"; ref[$2] = "F_" $2; grd[$2] = guard($3, $4)
+	fpos[$2] = nf
+	next
+}
+
+{
+	fail("bad definition `" $0 "'")
+}
+
+function fail(msg)
+{
+	printf("%s:%d: %s\n", FILENAME, NR, msg) > "/dev/stderr"
+	status = 1
+	exit 1
+}
+
+# the value of a char in a combo: ^X, ^?, ^- or undef, or a number
+function cc_value(v,    c)
+{
+	if (v == "undef" || v == "^-")
+		return "_POSIX_VDISABLE"
+	if (v == "^?")
+		return 127
+	if (length(v) == 2 && substr(v, 1, 1) == "^" &&
+		(c = index("@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_", substr(v, 2, 1))) > 0)
+		return c - 1
+	if (v ~ /^[0-9]+$/)
+		return v + 0
+	fail("bad char value `" v "'")
+}
+
+# one combo's settings as a struct sttyl_delta initializer; the CO_ macros
+# it uses are 0 where the system lacks the constant
+function combo_delta(text,    n, w, i, j, k, nm, t, set, clear, ncc, cc)
+{
+	n = split(text, w)
+	split("", state); split("", ccval); nfl = 0; ncv = 0
+	for (i = 1; i <= n; i++)
+	{
+		nm = w[i]; sub(/^-/, "", nm)
+		if (nm in cpos && w[i] == nm && i < n)
+		{
+			if (!(nm in ccval))
+				cvorder[++ncv] = nm
+			ccval[nm] = cc_value(w[++i])
+			used_cc[nm] = 1
+		}
+		else if (nm in fpos && !(w[i] != nm && fmask[fpos[nm]]))
+		{
+			if (!(nm in state))
+				florder[++nfl] = nm
+			state[nm] = (w[i] == nm)
+			used_flag[nm] = 1
+		}
+		else
+			fail("bad setting `" w[i] "' in combo")
+	}
+
+	split("iflag oflag cflag lflag", t)
+	set = ""; clear = ""
+	for (k = 1; k <= 4; k++)
+	{
+		s1 = "0"; c1 = "0"
+		for (j = 1; j <= nfl; j++)
+		{
+			nm = florder[j]
+			if (ftype[fpos[nm]] != t[k])
+				continue
+			if (!state[nm])
+				c1 = c1 " | CO_" nm
+			else
+			{
+				s1 = s1 " | CO_" nm
+				if (fmask[fpos[nm]])
+					c1 = c1 " | (CO_M_" nm " & ~CO_" nm ")"
+			}
+		}
+		set = set (k > 1 ? ",\n\t\t  " : "") s1
+		clear = clear (k > 1 ? ",\n\t\t  " : "") c1
+	}
+
+	ncc = "0"; cc = ""
+	for (j = 1; j <= ncv; j++)
+	{
+		nm = cvorder[j]
+		ncc = ncc " + CO_" nm
+		cc = cc sprintf("%s\n\t\t  { %s, %s },\n#endif\n", grd[nm],
+			cidx[cpos[nm]], ccval[nm])
+	}
+
+	return sprintf("\t\t{ { %s },\n\t\t{ %s },\n\t\t%s, {\n%s" \
+		"\t\t  { 0, 0 } },\n\t\t-1, -1, -1, -1, -1, TCSANOW, 0, -1, 0 }", set,
+		clear,
+		ncc, cc)
+}
+
+END {
+	if (status)
+		exit status
+
+	print "/* Generated by mktables.awk from sttyl.def -- do not edit. */"
+	print ""
+
+	print "enum table_pos {"
+	for (i = 1; i <= nf; i++)
+		printf("%s\n\tF_%s,\n#endif\n", grd[fname[i]], fname[i])
+	print "\tF_END"
+	print "};"
+	print "enum ctable_pos {"
+	for (i = 1; i <= nc; i++)
+		printf("%s\n\tC_%s,\n#endif\n", grd[cname[i]], cname[i])
+	print "\tC_END"
+	print "};"
+	print ""
+
+	print "static const struct table_t table[] = {"
+	for (i = 1; i <= nf; i++)
+		printf("%s\n\t{ %s, \"%s\", \"%s\", offsetof(struct termios, c_%s), %s },\n#endif\n",
+			grd[fname[i]], fflag[i], fname[i], ftype[i], ftype[i], fmask[i])
+	print "\t{ 0, NULL, NULL, 0, 0 }"
+	print "};"
+	print ""
+
+	print "static const struct ctable_t cchars[] = {"
+	for (i = 1; i <= nc; i++)
+		printf("%s\n\t{ %s, \"%s\", %d },\n#endif\n", grd[cname[i]], cidx[i],
+			cname[i], cnum[i])
+	print "\t{ 0, NULL, 0 }"
+	print "};"
+	print ""
+
+	# combos: build the deltas first, to know which CO_ macros they use
+	for (i = 1; i <= nk; i++)
+	{
+		if (!(kname[i] in cotext))
+			fail("combo `-" kname[i] "' without `" kname[i] "'")
+		ondelta[i] = combo_delta(cotext[kname[i]])
+		offdelta[i] = ("-" kname[i]) in cotext ? \
+			combo_delta(cotext["-" kname[i]]) : ""
+	}
+	for (i = 1; i <= nf; i++)
+		if (fname[i] in used_flag)
+			printf("%s\n#define CO_%s %s\n#define CO_M_%s %s\n#else\n" \
+				"#define CO_%s 0\n#define CO_M_%s 0\n#endif\n", grd[fname[i]],
+				fname[i], fflag[i], fname[i], fmask[i], fname[i], fname[i])
+	for (i = 1; i <= nc; i++)
+		if (cname[i] in used_cc)
+			printf("%s\n#define CO_%s 1\n#else\n#define CO_%s 0\n#endif\n",
+				grd[cname[i]], cname[i], cname[i])
+	print ""
+
+	print "enum combo_pos {"
+	for (i = 1; i <= nk; i++)
+		printf("\tK_%s,\n", kname[i])
+	print "\tK_END"
+	print "};"
+	print "static const struct combo_t combos[] = {"
+	for (i = 1; i <= nk; i++)
+	{
+		printf("\t{ \"%s\", %s,\n%s,\n", kname[i], offdelta[i] != "",
+			ondelta[i])
+		if (offdelta[i] != "")
+			printf("%s },\n", offdelta[i])
+		else
+			print "\t\t{ { 0 }, { 0 }, 0, { { 0, 0 } }, -1, -1, -1, -1, -1, " \
+				"TCSANOW, 0, -1, 0 } },"
+	}
+	print "};"
+	print ""
+
+	print "static const struct baud_t bauds[] = {"
+	for (i = 1; i <= nb; i++)
+		printf("#ifdef %s\n\t{ %s, %s },\n#endif\n", bcode[i], bcode[i], brate[i])
+	print "};"
+	print ""
+
+	# insertion sort of all names; run with LC_ALL=C to match strcmp()
+	n = 0
+	for (name in kind)
+	{
+		for (j = n++; j > 0 && sorted[j] > name; j--)
+			sorted[j + 1] = sorted[j]
+		sorted[j + 1] = name
+	}
+
+	print "enum opt_pos {"
+	for (i = 1; i <= n; i++)
+		printf("%s\n\tO_%s,\n#endif\n", grd[sorted[i]], sorted[i])
+	print "\tO_END"
+	print "};"
+	print "static const struct opt_t options[] = {"
+	for (i = 1; i <= n; i++)
+		printf("%s\n\t{ \"%s\", %s, %s },\n#endif\n", grd[sorted[i]],
+			sorted[i], kind[sorted[i]], ref[sorted[i]])
+	print "};"
+	print ""
+
+	# open-addressed hash of the names, at most half full, probed linearly;
+	# a name the system lacks leaves -2, so probes go on past it
+	for (size = 16; size < 2 * n; size *= 2)
+		;
+	for (i = 32; i < 127; i++)
+		ord[sprintf("%c", i)] = i
+	split("", slot)
+	for (i = 1; i <= n; i++)
+	{
+		for (h = j = 0; j < length(sorted[i]); j++)
+			h = (h * 31 + ord[substr(sorted[i], j + 1, 1)]) % 65536
+		for (h %= size; h in slot; h = (h + 1) % size)
+			;
+		slot[h] = sorted[i]
+	}
+	printf("#define OPT_HASH %d\n", size)
+	print "static const short opt_hash[OPT_HASH] = {"
+	for (h = 0; h < size; h++)
+		if (h in slot)
+			printf("%s\n\tO_%s,\n#else\n\t-2,\n#endif\n", grd[slot[h]],
+				slot[h])
+		else
+			print "\t-1,"
+	print "};"
+	print ""
+
+	# the flags report, one line per type, with each flag's mask and name
+	# as constants: "-name " is printed from its second char when the flag
+	# is on, and a choice in full only when selected
+	print "static void flag_lines(const struct termios *info)"
+	print "{"
+	print "\ttcflag_t w;"
+	for (i = 1; i <= nf; i++)
+		if (!(ftype[i] in tseen))
+		{
+			tseen[ftype[i]] = 1
+			types[++nt] = ftype[i]
+		}
+	for (k = 1; k <= nt; k++)
+	{
+		printf("\n\tw = info->c_%s;\n\tbuf_put(\"%s%ss: \", %d);\n",
+			types[k], k > 1 ? "\\n" : "", types[k],
+			length(types[k]) + 3 + (k > 1))
+		for (i = 1; i <= nf; i++)
+		{
+			if (ftype[i] != types[k])
+				continue
+			if (fmask[i])
+				printf("%s\n\tput_choice((w & %s) == %s, \"%s \", %d);\n",
+					grd[fname[i]], fmask[i], fflag[i], fname[i],
+					length(fname[i]) + 1)
+			else
+				printf("%s\n\tput_flag((w & %s) == %s, \"-%s \", %d);\n",
+					grd[fname[i]], fflag[i], fflag[i], fname[i],
+					length(fname[i]) + 2)
+			print "#endif"
+		}
+	}
+	if (nt > 0)
+		print "\tbuf_put(\"\\n\", 1);"
+	print "}"
+	print ""
+
+	# ^X for controls, ^? for DEL, M- for the high half; the space, which
+	# would end a word, is shown in hex. Every name reads back as its value.
+	print "static const char * const char_names[256] = {"
+	for (i = 0; i < 256; i++)
+	{
+		name = cname_of(i)
+		gsub(/["\\]/, "\\\\&", name)		# escaped for C
+		printf("\t\"%s\",%s", name, i % 8 == 7 ? "\n" : "")
+	}
+	print "};"
+	print ""
+
+	print "static const short caret_codes[256] = {"
+	for (i = 0; i < 256; i++)
+	{
+		if (i == 63)						# ^?; ^- is not a value
+			code = 127
+		else if (i >= 64 && i <= 95)		# ^@ to ^_
+			code = i - 64
+		else if (i >= 97 && i <= 122)		# ^a to ^z, as ^A to ^Z
+			code = i - 96
+		else
+			code = -1
+		printf("\t%s,%s", code, i % 8 == 7 ? "\n" : "")
+	}
+	print "};"
+}
+
+function cname_of(c)
+{
+	if (c >= 128)
+		return "M-" cname_of(c - 128)
+	if (c < 32)
+		return sprintf("^%c", c + 64)
+	if (c == 127)
+		return "^?"
+	if (c == 32)
+		return "0x20"
+	return sprintf("%c", c)
+}
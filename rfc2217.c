@@ -0,0 +1,841 @@
+/*
+ * ==========================
+ *   FILE: ./rfc2217.c
+ * ==========================
+ * Purpose: The RFC 2217 backend of libsttyl: a serial port on a terminal
+ *			server, named "rfc2217://host:port", set up over the telnet
+ *			COM-PORT-OPTION instead of with tcsetattr().
+ *
+ * Outline: Opening a port connects to it; the fd is the socket. Each call
+ *			on it is one write of every command it needs, then one wait
+ *			for all their replies, so it costs one round trip however many
+ *			settings change. A port has a termios struct of its own, the
+ *			shadow: the settings RFC 2217 can carry (the speed, character
+ *			size, parity, stop bits, and flow control) are read from the
+ *			server into it and written from it; the rest of termios is
+ *			kept here, so options like -echo still round-trip locally.
+ *
+ *			RFC 2217 is one port per connection, so many ports are many
+ *			connections; sttyl -j runs them at the same time, and is
+ *			bounded by the slowest server round trip, not the sum of them.
+ *
+ * Protocol: A telnet command is IAC (255) and a verb; for an option, the
+ *			option number follows. We send WILL COM-PORT-OPTION (44) once,
+ *			in the same write as the first commands; the server answers DO,
+ *			or DONT if it has no serial port behind it. A command is IAC SB
+ *			44 <code> <value> IAC SE, with 255 in the value sent twice; the
+ *			server replies with the same form and <code> + 100, giving the
+ *			value now in use. A value of 0 asks without changing anything.
+ *			Serial data and requests for other options are turned down or
+ *			thrown away: this connection only carries settings.
+ *
+ *			https://www.rfc-editor.org/rfc/rfc2217
+ */
+
+/* INCLUDES */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<poll.h>
+#include	<netdb.h>
+#include	<termios.h>
+#include	<sys/types.h>
+#include	<sys/socket.h>
+#include	<sys/ioctl.h>
+#include	<netinet/in.h>
+#include	<netinet/tcp.h>
+#include	"backend.h"
+
+/* CONSTANTS */
+#define YES 1
+#define NO  0
+#define PREFIX			"rfc2217://"
+#define MAXREMOTE		1024		//fds that can be ports: ports[] size
+#define REMOTE_TIMEOUT	5000		//ms to wait for the server, each time
+#define DRAIN_QUIET		500			//ms of no line state that means idle
+#define MAXCMD			128			//bytes of commands in one write
+
+/*
+ * the c_cflag bits the server has, rather than the shadow; parodd and
+ * cmspar are kept here while parity is off, as a tty keeps them
+ */
+#ifndef CMSPAR
+#define CMSPAR	0
+#endif
+#ifndef CRTSCTS
+#define CRTSCTS	0
+#endif
+#ifndef CBAUD
+#define CBAUD	0
+#endif
+#ifndef CIBAUD
+#define CIBAUD	0
+#endif
+#define REMOTE_CFLAG (CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | CIBAUD)
+
+/* telnet (RFC 854) */
+#define IAC		255
+#define DONT	254
+#define DO		253
+#define WONT	252
+#define WILL	251
+#define SB		250
+#define SE		240
+#define COM_PORT 44
+
+/* COM-PORT-OPTION commands, from the client; replies are 100 more */
+#define C_BAUD		1			//4 bytes, network order
+#define C_DATASIZE	2			//5 to 8
+#define C_PARITY	3			//see parity_of()
+#define C_STOPSIZE	4			//1, 2, or 3 for 1.5
+#define C_CONTROL	5			//flow control and modem lines
+#define C_LINESTATE	6			//NOTIFY-LINESTATE, from the server
+#define C_LINEMASK	10			//which line state changes to notify
+#define C_PURGE		12			//1 receive, 2 transmit, 3 both
+#define REPLY		100
+
+#define FLOW_OUT_ASK	0		//C_CONTROL values: outbound (IXON)
+#define FLOW_OUT_NONE	1
+#define FLOW_OUT_XON	2
+#define FLOW_OUT_HW		3
+#define FLOW_IN_ASK		13		//inbound (IXOFF)
+#define FLOW_IN_NONE	14
+#define FLOW_IN_XON		15
+#define FLOW_IN_HW		16
+#define DTR_ON			8		//B0 is DTR off, as for a tty
+#define DTR_OFF			9
+#define LS_TSRE			0x40	//line state: transmitter empty
+
+/* the replies a call waits for, as bits */
+#define R_BAUD		0x01
+#define R_DATASIZE	0x02
+#define R_PARITY	0x04
+#define R_STOPSIZE	0x08
+#define R_FLOW_OUT	0x10
+#define R_FLOW_IN	0x20
+#define R_PURGE		0x40
+#define R_DTR		0x80
+#define R_LINEMASK	0x100
+#define R_LINESTATE	0x200		//a notification, not a reply
+#define R_SETTINGS	0x3f
+
+/* parser states, one per kind of byte expected next */
+enum {P_DATA, P_IAC, P_OPTION, P_SB, P_SB_IAC};
+
+/*
+ * A connected port. The parser state is kept between reads, so a reply
+ * may arrive in pieces. got[] is what the server last said for each R_
+ * bit, in bit order.
+ */
+#define NGOT 10
+struct port_t {int used; int told; int refused;
+			   struct termios shadow; int rate;		//rate: if not in bauds[]
+			   int hungup;							//DTR off, for B0
+			   int state; int verb; unsigned char sb[8]; int sblen;
+			   int have; int got[NGOT]; };
+
+/* FUNCTION PROTOTYPES */
+static int r_open(const char *);
+static int r_close(int);
+static int r_get(int, struct termios *);
+static int r_set(int, int, const struct termios *);
+static int r_ioctl(int, unsigned long, void *);
+static int r_flush(int, int);
+static int r_drain(int);
+static int r_owns(int);
+
+static int dial(const char *);
+static int sync_port(int, const struct termios *, int, int);
+static int parity_of(tcflag_t);
+static void add_cmd(int, unsigned char *, int *, int, unsigned long, int);
+static int send_all(int, const unsigned char *, int);
+static int await(int, int, int);
+static void parse(int, const unsigned char *, int);
+static void reply(struct port_t *);
+static void shadow_update(struct port_t *);
+
+/* FILE-SCOPE VARIABLES */
+const struct backend_t rfc2217_backend = {
+	PREFIX, r_open, r_close, r_get, r_set, r_ioctl, r_flush, r_drain, r_owns
+};
+static struct port_t ports[MAXREMOTE];		//by fd; each fd is one thread's
+
+/*
+ *	r_open()
+ *	Purpose: Connect to a port on a terminal server.
+ *	  Input: name, "rfc2217://host:port", where host may be a name, an IPv4
+ *			 address, or an IPv6 address in brackets
+ *	 Return: The socket, or -1 with errno set: EINVAL for a name without a
+ *			 port, ENOENT for a host that cannot be found, ETIMEDOUT if the
+ *			 server does not answer within REMOTE_TIMEOUT, or the error
+ *			 from connect(), e.g. ECONNREFUSED.
+ *	   Note: Nothing is sent yet; the first call on the port starts the
+ *			 telnet negotiation, in the same write as its own commands.
+ */
+static int r_open(const char *name)
+{
+	struct port_t *p;
+	int fd;
+
+	if ( (fd = dial(name + strlen(PREFIX))) == -1 )
+		return -1;
+	if (fd >= MAXREMOTE)
+	{
+		close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+
+	p = &ports[fd];
+	memset(p, 0, sizeof(struct port_t));
+	p->shadow.c_cflag = CREAD | CS8;				//cc[] all disabled
+	cfsetispeed(&p->shadow, B9600);
+	cfsetospeed(&p->shadow, B9600);
+	p->rate = 9600;
+	p->used = YES;
+	return fd;
+}
+
+/*
+ *	dial()
+ *	Purpose: Make the TCP connection for r_open().
+ *	  Input: addr, "host:port" or "[v6 address]:port"
+ *	 Return: The connected socket, or -1 with errno set, as r_open().
+ *	 Method: Try each address the host has, with a non-blocking connect()
+ *			 and poll(), so a host that is down cannot hang the caller for
+ *			 the minutes the kernel would wait. Nagle's algorithm is turned
+ *			 off, as every write is a whole request that is waited on.
+ */
+static int dial(const char *addr)
+{
+	char host[256], *port;
+	struct addrinfo hints, *list, *ai;
+	struct pollfd pfd;
+	socklen_t len = sizeof(int);
+	int fd = -1, err = ENOENT, one = 1;
+
+	if (strlen(addr) >= sizeof(host))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	strcpy(host, addr[0] == '[' ? addr + 1 : addr);
+	port = strrchr(host, ':');
+	if (port == NULL || port[1] == '\0' || (addr[0] == '[' && port[-1] != ']'))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	*port++ = '\0';
+	if (addr[0] == '[')
+		port[-2] = '\0';							//the ']'
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &list) != 0)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	for(ai = list; ai != NULL && fd == -1; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK |
+					SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd == -1)
+		{
+			err = errno;
+			continue;
+		}
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == -1)
+		{
+			err = errno;
+			if (err == EINPROGRESS)
+			{
+				err = ETIMEDOUT;
+				if (poll(&pfd, 1, REMOTE_TIMEOUT) == 1 &&
+					getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+					err == 0)
+					continue;						//connected
+			}
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(list);
+
+	if (fd == -1)
+		errno = err;
+	else
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+/*
+ *	r_close(), r_owns()
+ *	Purpose: Close a port, and tell whether an fd is one.
+ */
+static int r_close(int fd)
+{
+	ports[fd].used = NO;
+	return close(fd);
+}
+
+static int r_owns(int fd)
+{
+	return fd >= 0 && fd < MAXREMOTE && ports[fd].used;
+}
+
+/*
+ *	r_get()
+ *	Purpose: tcgetattr() for a port.
+ *	  Input: fd, the port
+ *			 info, where to store its settings
+ *	 Return: 0, or -1 with errno set (see await()).
+ *	 Method: The six settings are asked for in one write, and the replies
+ *			 waited for together; they update the shadow, which is copied.
+ */
+static int r_get(int fd, struct termios *info)
+{
+	unsigned char cmd[MAXCMD];
+	int n = 0;
+
+	add_cmd(fd, cmd, &n, C_BAUD, 0, 4);
+	add_cmd(fd, cmd, &n, C_DATASIZE, 0, 1);
+	add_cmd(fd, cmd, &n, C_PARITY, 0, 1);
+	add_cmd(fd, cmd, &n, C_STOPSIZE, 0, 1);
+	add_cmd(fd, cmd, &n, C_CONTROL, FLOW_OUT_ASK, 1);
+	add_cmd(fd, cmd, &n, C_CONTROL, FLOW_IN_ASK, 1);
+
+	ports[fd].have = 0;
+	if (send_all(fd, cmd, n) == -1 ||
+		await(fd, R_SETTINGS, REMOTE_TIMEOUT) == -1)
+		return -1;
+
+	*info = ports[fd].shadow;
+	return 0;
+}
+
+/*
+ *	r_set()
+ *	Purpose: tcsetattr() for a port.
+ *	  Input: fd, the port
+ *			 action, TCSANOW, TCSADRAIN, or TCSAFLUSH
+ *			 info, the settings to write
+ *	 Return: 0, or -1 with errno set.
+ *	   Note: As with tcsetattr(), a setting the server does not take is not
+ *			 an error: the shadow has what it chose, for a verify to see.
+ */
+static int r_set(int fd, int action, const struct termios *info)
+{
+	int rate = sttyl_rate_of(cfgetospeed(info));
+
+	if (rate < 0)									//BOTHER: same rate
+		rate = ports[fd].rate;
+	return sync_port(fd, info, rate, action);
+}
+
+/*
+ *	sync_port()
+ *	Purpose: Bring a port's settings in line with a termios struct.
+ *	  Input: fd, the port
+ *			 info, the settings wanted
+ *			 rate, the speed wanted, in bits per second
+ *			 action, TCSANOW, TCSADRAIN, or TCSAFLUSH
+ *	 Return: 0, or -1 with errno set.
+ *	 Method: For TCSADRAIN and TCSAFLUSH, the output is drained first by
+ *			 r_drain(), and for TCSAFLUSH the input purged by r_flush(), as
+ *			 tcsetattr() does. Only the settings that differ from the shadow
+ *			 are sent, all in one write; the rest of info is just copied
+ *			 into the shadow, before the replies put in what the server
+ *			 chose.
+ *	   Note: A rate of 0 is B0, hang up. A C_BAUD of 0 would only ask for
+ *			 the rate, so it is sent as DTR off instead, and the rate is
+ *			 kept; a real rate after it turns DTR back on.
+ */
+static int sync_port(int fd, const struct termios *info, int rate,
+					 int action)
+{
+	struct port_t *p = &ports[fd];
+	unsigned char cmd[MAXCMD];
+	tcflag_t was = p->shadow.c_cflag, now = info->c_cflag;
+	tcflag_t wasi = p->shadow.c_iflag, nowi = info->c_iflag;
+	int n = 0, want = 0;
+
+	if ((action == TCSADRAIN || action == TCSAFLUSH) && r_drain(fd) == -1)
+		return -1;
+	if (action == TCSAFLUSH && r_flush(fd, TCIFLUSH) == -1)
+		return -1;
+
+	if (rate != 0 && rate != p->rate)
+	{
+		add_cmd(fd, cmd, &n, C_BAUD, rate, 4);
+		want |= R_BAUD;
+	}
+	if ((rate == 0) != (p->hungup == YES))
+	{
+		add_cmd(fd, cmd, &n, C_CONTROL, rate == 0 ? DTR_OFF : DTR_ON, 1);
+		want |= R_DTR;
+	}
+	if ((now & CSIZE) != (was & CSIZE))
+	{
+		add_cmd(fd, cmd, &n, C_DATASIZE, (now & CSIZE) == CS5 ? 5 :
+				(now & CSIZE) == CS6 ? 6 : (now & CSIZE) == CS7 ? 7 : 8, 1);
+		want |= R_DATASIZE;
+	}
+	if (parity_of(now) != parity_of(was))
+	{
+		add_cmd(fd, cmd, &n, C_PARITY, parity_of(now), 1);
+		want |= R_PARITY;
+	}
+	if ((now & CSTOPB) != (was & CSTOPB))
+	{
+		add_cmd(fd, cmd, &n, C_STOPSIZE, now & CSTOPB ? 2 : 1, 1);
+		want |= R_STOPSIZE;
+	}
+	if ((now & CRTSCTS) != (was & CRTSCTS) || (nowi & IXON) != (wasi & IXON))
+	{
+		add_cmd(fd, cmd, &n, C_CONTROL, now & CRTSCTS ? FLOW_OUT_HW :
+				nowi & IXON ? FLOW_OUT_XON : FLOW_OUT_NONE, 1);
+		want |= R_FLOW_OUT;
+	}
+	if ((now & CRTSCTS) != (was & CRTSCTS) || (nowi & IXOFF) != (wasi & IXOFF))
+	{
+		add_cmd(fd, cmd, &n, C_CONTROL, now & CRTSCTS ? FLOW_IN_HW :
+				nowi & IXOFF ? FLOW_IN_XON : FLOW_IN_NONE, 1);
+		want |= R_FLOW_IN;
+	}
+
+	p->shadow.c_iflag = (info->c_iflag & ~(IXON | IXOFF)) |
+						(p->shadow.c_iflag & (IXON | IXOFF));
+	p->shadow.c_oflag = info->c_oflag;
+	p->shadow.c_cflag = (info->c_cflag & ~REMOTE_CFLAG) |
+						(p->shadow.c_cflag & REMOTE_CFLAG);
+	p->shadow.c_lflag = info->c_lflag;
+	memcpy(p->shadow.c_cc, info->c_cc, sizeof(info->c_cc));
+
+	p->have = 0;
+	if (want != 0 && (send_all(fd, cmd, n) == -1 ||
+					  await(fd, want, REMOTE_TIMEOUT) == -1))
+		return -1;
+	return 0;
+}
+
+/*
+ *	parity_of()
+ *	Purpose: The C_PARITY value for a set of c_cflag bits.
+ *	 Return: 1 none, 2 odd, 3 even, 4 mark, or 5 space.
+ */
+static int parity_of(tcflag_t cflag)
+{
+	if ((cflag & PARENB) == 0)
+		return 1;
+	if (cflag & CMSPAR)
+		return cflag & PARODD ? 4 : 5;
+	return cflag & PARODD ? 2 : 3;
+}
+
+/*
+ *	r_ioctl()
+ *	Purpose: The ioctl()s libsttyl makes, for a port.
+ *	 Return: 0, or -1 with errno set: ENOTTY for any request that has no
+ *			 RFC 2217 command, as for a local file that is not a serial
+ *			 port, so the library leaves out what it would have shown.
+ *	   Note: There is no window, so TIOCGWINSZ gives 0 rows and columns.
+ *			 The termios2 requests carry a rate that is not in bauds[];
+ *			 only the speeds are taken from them, as set_rate() changes
+ *			 nothing else.
+ */
+static int r_ioctl(int fd, unsigned long request, void *arg)
+{
+#ifdef HAVE_TERMIOS2
+	struct termios2 *t2 = arg;
+	struct termios info;
+#endif
+
+	if (request == TIOCGWINSZ)
+	{
+		memset(arg, 0, sizeof(struct winsize));
+		return 0;
+	}
+#ifdef HAVE_TERMIOS2
+	if (request == TCGETS2)
+	{
+		memset(t2, 0, sizeof(struct termios2));
+		t2->c_iflag = ports[fd].shadow.c_iflag;
+		t2->c_oflag = ports[fd].shadow.c_oflag;
+		t2->c_cflag = ports[fd].shadow.c_cflag;
+		t2->c_lflag = ports[fd].shadow.c_lflag;
+		t2->c_ispeed = t2->c_ospeed = ports[fd].hungup ? 0 : ports[fd].rate;
+		return 0;
+	}
+	if (request == TCSETS2 || request == TCSETSW2 || request == TCSETSF2)
+	{
+		info = ports[fd].shadow;
+		return sync_port(fd, &info, t2->c_ospeed, request == TCSETS2 ?
+						 TCSANOW : request == TCSETSW2 ? TCSADRAIN : TCSAFLUSH);
+	}
+#endif
+
+	errno = ENOTTY;
+	return -1;
+}
+
+/*
+ *	r_flush(), r_drain()
+ *	Purpose: tcflush() and tcdrain() for a port.
+ *	 Method: A flush is a C_PURGE of the same queues. There is no command
+ *			 to drain, but the server can be asked to notify changes of the
+ *			 transmitter empty line state: r_drain() turns that on, waits
+ *			 for a notification with it set, and turns it off again. As one
+ *			 is only sent on a change, a line that was empty all along says
+ *			 nothing, so DRAIN_QUIET ms without one is taken as empty.
+ */
+static int r_flush(int fd, int queue)
+{
+	unsigned char cmd[MAXCMD];
+	int n = 0;
+
+	add_cmd(fd, cmd, &n, C_PURGE, queue == TCIFLUSH ? 1 :
+			queue == TCOFLUSH ? 2 : 3, 1);
+	ports[fd].have = 0;
+	if (send_all(fd, cmd, n) == -1)
+		return -1;
+	return await(fd, R_PURGE, REMOTE_TIMEOUT);
+}
+
+static int r_drain(int fd)
+{
+	struct port_t *p = &ports[fd];
+	unsigned char cmd[MAXCMD];
+	int n = 0;
+
+	add_cmd(fd, cmd, &n, C_LINEMASK, LS_TSRE, 1);
+	p->have = 0;
+	if (send_all(fd, cmd, n) == -1 ||
+		await(fd, R_LINEMASK, REMOTE_TIMEOUT) == -1)
+		return -1;
+
+	while ((p->have & R_LINESTATE) == 0 || (p->got[9] & LS_TSRE) == 0)
+	{
+		p->have &= ~R_LINESTATE;					//still sending: wait on
+		if (await(fd, R_LINESTATE, DRAIN_QUIET) == -1)
+		{
+			if (errno != ETIMEDOUT)
+				return -1;
+			break;									//quiet: already empty
+		}
+	}
+
+	n = 0;
+	add_cmd(fd, cmd, &n, C_LINEMASK, 0, 1);
+	p->have = 0;
+	if (send_all(fd, cmd, n) == -1)
+		return -1;
+	return await(fd, R_LINEMASK, REMOTE_TIMEOUT);
+}
+
+/*
+ *	add_cmd()
+ *	Purpose: Add a COM-PORT-OPTION command to a write being built.
+ *	  Input: fd, the port, which is sent WILL COM-PORT-OPTION first, the
+ *			 first time
+ *			 cmd, n, the bytes so far and how many there are
+ *			 code, the command, e.g. C_BAUD
+ *			 value, len, its value, in len bytes
+ */
+static void add_cmd(int fd, unsigned char *cmd, int *n, int code,
+					unsigned long value, int len)
+{
+	unsigned char c;
+
+	if (ports[fd].told == NO)
+	{
+		cmd[(*n)++] = IAC;
+		cmd[(*n)++] = WILL;
+		cmd[(*n)++] = COM_PORT;
+		ports[fd].told = YES;
+	}
+
+	cmd[(*n)++] = IAC;
+	cmd[(*n)++] = SB;
+	cmd[(*n)++] = COM_PORT;
+	cmd[(*n)++] = code;
+	while (len-- > 0)
+	{
+		c = (value >> (8 * len)) & 0xff;
+		cmd[(*n)++] = c;
+		if (c == IAC)								//IAC in data is doubled
+			cmd[(*n)++] = IAC;
+	}
+	cmd[(*n)++] = IAC;
+	cmd[(*n)++] = SE;
+	return;
+}
+
+/*
+ *	send_all()
+ *	Purpose: Write a request to a port, all of it.
+ *	 Return: 0, or -1 with errno set, e.g. EPIPE if the server has gone.
+ */
+static int send_all(int fd, const unsigned char *buf, int len)
+{
+	struct pollfd pfd = {fd, POLLOUT, 0};
+	ssize_t n;
+
+	while (len > 0)
+	{
+		if ( (n = send(fd, buf, len, MSG_NOSIGNAL)) > 0 )
+		{
+			buf += n;
+			len -= n;
+		}
+		else if (n == -1 && errno != EAGAIN && errno != EINTR)
+			return -1;
+		else if (n == -1 && errno == EAGAIN && poll(&pfd, 1, REMOTE_TIMEOUT)
+				 == 0)
+		{
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *	await()
+ *	Purpose: Read from a port until the server has replied to a request.
+ *	  Input: fd, the port
+ *			 want, the R_ bits of the replies expected
+ *			 ms, how long the server may be silent, e.g. REMOTE_TIMEOUT
+ *	 Return: 0, or -1 with errno set: ETIMEDOUT if the server is silent
+ *			 for ms, EIO if it closed the connection (as for a
+ *			 tty that was hung up), or EPROTONOSUPPORT if it refused
+ *			 COM-PORT-OPTION.
+ */
+static int await(int fd, int want, int ms)
+{
+	struct port_t *p = &ports[fd];
+	struct pollfd pfd = {fd, POLLIN, 0};
+	unsigned char buf[512];
+	ssize_t n;
+
+	while ((p->have & want) != want && p->refused == NO)
+	{
+		if ( (n = recv(fd, buf, sizeof(buf), 0)) > 0 )
+			parse(fd, buf, n);
+		else if (n == 0)
+		{
+			errno = EIO;
+			return -1;
+		}
+		else if (errno != EAGAIN && errno != EINTR)
+			return -1;
+		else if (errno == EAGAIN && poll(&pfd, 1, ms) == 0)
+		{
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	if (p->refused == YES)
+	{
+		errno = EPROTONOSUPPORT;
+		return -1;
+	}
+	shadow_update(p);
+	return 0;
+}
+
+/*
+ *	parse()
+ *	Purpose: Take in bytes read from a port.
+ *	  Input: fd, the port
+ *			 buf, len, the bytes
+ *	 Method: A state machine over the telnet stream. Serial data is thrown
+ *			 away. An offer of any option is refused (WILL -> DONT, DO ->
+ *			 WONT), except DO COM-PORT-OPTION, which answers our WILL. A
+ *			 subnegotiation is collected, IAC IAC read as one 255, and
+ *			 handed to reply() at IAC SE.
+ */
+static void parse(int fd, const unsigned char *buf, int len)
+{
+	struct port_t *p = &ports[fd];
+	unsigned char no[3] = {IAC, 0, 0};
+	int i, c;
+
+	for(i = 0; i < len; i++)
+	{
+		c = buf[i];
+		switch (p->state)
+		{
+			case P_DATA:
+				if (c == IAC)
+					p->state = P_IAC;
+				break;
+			case P_IAC:
+				p->state = P_DATA;
+				if (c == SB)
+				{
+					p->state = P_SB;
+					p->sblen = 0;
+				}
+				else if (c == WILL || c == WONT || c == DO || c == DONT)
+				{
+					p->verb = c;
+					p->state = P_OPTION;
+				}
+				break;
+			case P_OPTION:
+				p->state = P_DATA;
+				if (c == COM_PORT && (p->verb == DONT || p->verb == WONT))
+					p->refused = p->verb == DONT ? YES : p->refused;
+				else if (c != COM_PORT && (p->verb == WILL || p->verb == DO))
+				{
+					no[1] = p->verb == WILL ? DONT : WONT;
+					no[2] = c;
+					send_all(fd, no, 3);
+				}
+				break;
+			case P_SB:
+				if (c == IAC)
+					p->state = P_SB_IAC;
+				else if (p->sblen < (int) sizeof(p->sb))
+					p->sb[p->sblen++] = c;
+				break;
+			case P_SB_IAC:
+				p->state = P_SB;
+				if (c == IAC && p->sblen < (int) sizeof(p->sb))
+					p->sb[p->sblen++] = c;
+				else if (c == SE)
+				{
+					p->state = P_DATA;
+					if (p->sblen >= 3 && p->sb[0] == COM_PORT)
+						reply(p);
+				}
+				break;
+		}
+	}
+
+	return;
+}
+
+/*
+ *	reply()
+ *	Purpose: Record a COM-PORT-OPTION reply, in the R_ bit it answers.
+ *	  Input: p, the port, with the subnegotiation in sb[]: 44, the code,
+ *			 and the value
+ *	   Note: Both flow control queries, and DTR, are answered as C_CONTROL;
+ *			 which one a reply is for shows in its value. A line state
+ *			 notification is kept as if it were a reply; other ones, e.g.
+ *			 of the modem state, are ignored.
+ */
+static void reply(struct port_t *p)
+{
+	int code = p->sb[1], v = p->sb[2], bit;
+
+	if (code == REPLY + C_BAUD && p->sblen >= 6)
+		v = ((unsigned long) p->sb[2] << 24) | (p->sb[3] << 16) |
+			(p->sb[4] << 8) | p->sb[5];
+
+	switch (code - REPLY)
+	{
+		case C_BAUD:		bit = 0;	break;
+		case C_DATASIZE:	bit = 1;	break;
+		case C_PARITY:		bit = 2;	break;
+		case C_STOPSIZE:	bit = 3;	break;
+		case C_CONTROL:
+			if (v >= FLOW_OUT_NONE && v <= FLOW_OUT_HW)
+				bit = 4;
+			else if (v >= FLOW_IN_NONE && v <= FLOW_IN_HW)
+				bit = 5;
+			else if (v == DTR_ON || v == DTR_OFF)
+				bit = 7;
+			else
+				return;
+			break;
+		case C_PURGE:		bit = 6;	break;
+		case C_LINEMASK:	bit = 8;	break;
+		case C_LINESTATE:	bit = 9;	break;
+		default:			return;
+	}
+
+	p->got[bit] = v;
+	p->have |= 1 << bit;
+	return;
+}
+
+/*
+ *	shadow_update()
+ *	Purpose: Put the values the server gave into the shadow termios.
+ *	  Input: p, the port, with have telling which got[] values are new
+ *	   Note: A value of 0 means the server did not say, and is skipped.
+ *			 While DTR is off the speed is B0, whatever the rate.
+ */
+static void shadow_update(struct port_t *p)
+{
+	struct termios *t = &p->shadow;
+	int *got = p->got;
+	speed_t code;
+
+	if ((p->have & R_BAUD) && got[0] > 0)
+	{
+		p->rate = got[0];
+		if (sttyl_code_of(got[0], &code) == YES)
+		{
+			cfsetispeed(t, code);
+			cfsetospeed(t, code);
+		}
+#ifdef HAVE_TERMIOS2
+		else
+			t->c_cflag = (t->c_cflag & ~CBAUD) | BOTHER;
+#endif
+	}
+	if ((p->have & R_DATASIZE) && got[1] >= 5 && got[1] <= 8)
+		t->c_cflag = (t->c_cflag & ~CSIZE) | (got[1] == 5 ? CS5 :
+					 got[1] == 6 ? CS6 : got[1] == 7 ? CS7 : CS8);
+	if ((p->have & R_PARITY) && got[2] == 1)
+		t->c_cflag &= ~PARENB;
+	else if ((p->have & R_PARITY) && got[2] >= 2 && got[2] <= 5)
+	{
+		t->c_cflag &= ~(PARODD | CMSPAR);
+		t->c_cflag |= got[2] == 2 ? PARENB | PARODD : got[2] == 3 ? PARENB :
+					  got[2] == 4 ? PARENB | PARODD | CMSPAR : PARENB | CMSPAR;
+	}
+	if ((p->have & R_STOPSIZE) && got[3] > 0)
+		t->c_cflag = got[3] == 1 ? t->c_cflag & ~CSTOPB : t->c_cflag | CSTOPB;
+	if (p->have & R_FLOW_OUT)
+	{
+		t->c_iflag = got[4] == FLOW_OUT_XON ? t->c_iflag | IXON :
+					 t->c_iflag & ~IXON;
+		t->c_cflag = got[4] == FLOW_OUT_HW ? t->c_cflag | CRTSCTS :
+					 t->c_cflag & ~CRTSCTS;
+	}
+	if (p->have & R_FLOW_IN)
+		t->c_iflag = got[5] == FLOW_IN_XON ? t->c_iflag | IXOFF :
+					 t->c_iflag & ~IXOFF;
+	if (p->have & R_DTR)
+		p->hungup = got[7] == DTR_OFF ? YES : NO;
+	if (p->hungup == YES)
+	{
+		cfsetispeed(t, B0);
+		cfsetospeed(t, B0);
+	}
+	else if ((p->have & R_DTR) && sttyl_code_of(p->rate, &code) == YES)
+	{
+		cfsetispeed(t, code);						//back from B0
+		cfsetospeed(t, code);
+	}
+#ifdef HAVE_TERMIOS2
+	else if (p->have & R_DTR)
+		t->c_cflag = (t->c_cflag & ~CBAUD) | BOTHER;
+#endif
+
+	return;
+}
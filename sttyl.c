@@ -5,451 +5,2244 @@
  * Purpose: Set a limited number of options for a terminal device interface.
  *
  * Outline: sttyl with no arguments will print the current values for options
- *			it knows about. Special characters you can change are erase and
- *			kill. Other attributes can be set (turned on) using the name, or
- *			unset (turned off) by adding a '-' before the attribute. See usage
- *			below for examples.
+ *			it knows about. Special characters are set by name, e.g. erase
+ *			or kill, and min and time by number. Other attributes can be set
+ *			(turned on) using the name, or unset (turned off) by adding a '-'
+ *			before the attribute. See usage below for examples.
  *
  * Usage:	./sttyl							-- no options, prints current vals
  *			./sttyl -echo onlcr erase ^X	-- turns off echo, turns on onlcr
  *											   and sets the erase char to ^X
+ *			./sttyl -F /dev/ttyS0 -echo		-- same, but for /dev/ttyS0
+ *			./sttyl -F /dev/ttyS0 low_latency xmit_fifo_size 16
+ *											-- serial port driver options
+ *			./sttyl --devices '/dev/ttyS*,/dev/ttyUSB0' -echo
+ *											-- parse once, apply to each
+ *			./sttyl --stats -echo			-- also report writes skipped
+ *			./sttyl --trace -F /dev/ttyS0 -echo
+ *											-- time each system call
+ *			./sttyl --verify --when drain 9600
+ *											-- after output drains, set and
+ *											   check, or roll back
+ *			./sttyl --drain --flush in -F /dev/ttyS0 9600
+ *											-- finish the frame, then change
+ *			./sttyl -j 8 --devices '/dev/ttyUSB*' 115200
+ *											-- apply with 8 threads
+ *			./sttyl -j 8 -F rfc2217://ts1:2001 -F rfc2217://ts1:2002 cs8
+ *											-- ports on a terminal server
+ *			./sttyl --daemon -F '/dev/ttyUSB*' 115200
+ *											-- and re-apply on hot-plug
+ *			./sttyl --watch -F /dev/ttyS0 -echo icanon
+ *											-- report drift from settings
+ *			./sttyl --watch --interval 10 -F rfc2217://ts1:2001 9600
+ *											-- a remote port is only checked
+ *											   each --interval seconds
+ *			./sttyl --batch lines.txt		-- "device settings" per line
+ *			./sttyl --snapshot ports.snap -F '/dev/ttyS*'
+ *											-- save the state of each port
+ *			./sttyl --diff ports.snap		-- show only what has changed
+ *			./sttyl -g						-- print state, for restoring
+ *			./sttyl --json					-- print state as JSON
+ *			./sttyl --fields flags,cchars	-- print only those parts
+ *			./sttyl --profile modem			-- use a compiled profile
+ *			./sttyl --compile-profiles profiles profiles.bin
+ *											-- compile profile definitions
  *
- * Tables: sttyl is a table-driven program. The tables are defined below.
- *		There is a single table that contains structs for each of the four
- *		flag types in termios: c_iflag, c_oflag, c_cflag, and c_lflag. There
- *		is a separate table that contains structs storing the special
- *		characters. The table of flags contains an offset corresponding to
- *		the position in a termios struct where the bit-mask for the flag can
- *		be found. To read how this is implemented and works, read the Plan
- *		document.
+ * Library: The settings themselves -- the tables, parsing, applying, and
+ *		the reports -- are in libsttyl (libsttyl.c, interface in sttyl.h).
+ *		This file is the command line around it: the options, the device
+ *		list, threads, the daemon and drift monitor, profiles, and the
+ *		messages and exit status.
  */
 
 /* INCLUDES */
 #include	<stdio.h>
-#include	<stddef.h>
 #include	<termios.h>
 #include	<stdlib.h>
 #include	<string.h>
 #include	<unistd.h>
-#include	<sys/ioctl.h>
+#include	<fcntl.h>
+#include	<glob.h>
+#include	<errno.h>
+#include	<stdarg.h>
 #include	<ctype.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+#include	<pthread.h>
+#include	<fnmatch.h>
+#include	<limits.h>
+#include	<sys/inotify.h>
+#include	<sys/epoll.h>
+#include	<sys/select.h>
+#include	<signal.h>
+#include	<time.h>
+#include	"sttyl.h"
 
 /* CONSTANTS */
-#define CHAR_MASK 64
 #define ERROR 1
-#define ON	1
-#define OFF 0
 #define YES 1
 #define NO  0
+#define OUTSIZE 8192
+#define BATCHBUF 65536			//--batch: longest line, and read() size
+#define BATCHARGS 256			//--batch: most words on one line
 
-/* TABLES DEFINITIONS */
-struct table_t {tcflag_t flag; char *name; char *type; unsigned long mode; };
-struct ctable_t {cc_t c_value; char *c_name; };
-
-struct table_t table[] = {
-	{ ICRNL		, "icrnl"	, "iflag"	, offsetof(struct termios, c_iflag)},
-	{ OPOST		, "opost"	, "oflag"	, offsetof(struct termios, c_oflag)},
-	{ HUPCL		, "hupcl"	, "cflag"	, offsetof(struct termios, c_cflag)},
-	{ ISIG		, "isig"	, "lflag"	, offsetof(struct termios, c_lflag)},
-	{ ICANON	, "icanon"	, "lflag"	, offsetof(struct termios, c_lflag)},
-	{ ECHO		, "echo"	, "lflag"	, offsetof(struct termios, c_lflag)},
-	{ ECHOE		, "echoe"	, "lflag"	, offsetof(struct termios, c_lflag)},
-	{ ECHOK		, "echok"	, "lflag"	, offsetof(struct termios, c_lflag)},
-	{ 0			, NULL		, NULL		, 0 }
-};
-struct ctable_t cchars[] = {
-	{ VEOF		,	"eof"} ,
-	{ VEOL		,	"eol" },
-	{ VERASE	,	"erase" },
-	{ VINTR		,	"intr" },
-	{ VKILL		,	"kill" },
-	{ VQUIT		,	"quit" },
-	{ VSUSP		,	"susp" },
-	{ 0			,	NULL }
+/*
+ * A compiled profile file is a header followed by an array of named deltas,
+ * sorted by name, exactly as they are laid out in memory. It is mmap()ed and
+ * searched with bsearch(), so using a profile needs no parsing at all. The
+ * entry size in the header guards against a file from a different build.
+ */
+#define PROFILE_MAGIC	"STTYLPF1"
+#define PROFILE_NAME	32
+#define PROFILE_FILE	"/etc/sttyl/profiles.bin"	//or $STTYL_PROFILES
+struct prof_head_t {char magic[8]; unsigned int count; unsigned int size; };
+struct prof_t {char name[PROFILE_NAME]; struct sttyl_delta delta; };
+
+/*
+ * A snapshot file is a header followed by one record per device: the length
+ * of the name, the name (not terminated), and the device's struct
+ * sttyl_state, the flag words and c_cc[] that -g prints. Records are packed
+ * end to end, so they are copied out rather than used in place. As for
+ * profiles, the state size in the header guards against another build.
+ */
+#define SNAP_MAGIC		"STTYLSN1"
+struct snap_head_t {char magic[8]; unsigned int count; unsigned int size; };
+
+/*
+ * With -j, devices are shared out to a pool of threads. Each job records
+ * its own result, and the main thread reports them in device order once
+ * all workers are done. With --trace, each job also keeps the library's
+ * trace of its device.
+ */
+struct job_t {char *name; int result; int err; char *step;
+			 struct sttyl_trace trace; };
+
+/*
+ * A device that could not be configured is recorded, with the stage that
+ * failed, and the run goes on with the others; it ends with one summary
+ * (see show_failures()). The stages index fail_names[].
+ */
+#define F_OPEN		0			//open()
+#define F_READ		1			//tcgetattr(), to show the settings
+#define F_APPLY		2			//sttyl_apply(): reading, writing, verifying
+#define F_REPORT	3			//the report, e.g. no window size
+#define F_PARSE		4			//a bad setting on a --batch line
+#define NFAIL		5
+static const char *fail_names[NFAIL] = {
+	"open", "read", "apply", "report", "parse"
 };
 
-/* DISPLAY INFO */
-void show_tty(struct termios *);
-void show_charset(struct termios *);
-void show_flagset(struct termios *);
+/*
+ * --batch and --daemon keep the last few devices they used open, by path,
+ * with the settings each was last known to have, so a device named again
+ * costs no open() (which, with hupcl, also drops DTR on the last close) and
+ * no tcgetattr(). The least recently used one is closed to make room.
+ */
+#define FDCACHE		8
+struct fdslot_t {char *name; int fd; int known; unsigned long used;
+				 struct termios info; };
+
+/* a device held open by --watch, and what was last reported for it */
+struct wdev_t {char *name; int fd; int drifted; int down;
+			   struct termios last; };
+struct pool_t {struct job_t *jobs; size_t njobs; size_t next;
+			   struct sttyl_delta *delta; pthread_mutex_t lock; };
+
+/* DEVICE PROCESSING */
+int parse_args(char **, struct sttyl_delta *, glob_t *);
+int finish(glob_t *, int);
+void add_devices(char *, glob_t *);
+int config_device(char *, int, struct sttyl_delta *, int);
+void show_stats();
+int add_failure(char *, int);
+void show_failures();
 
-/* OPTION PROCESSING */
-int valid_char_opt(char *, struct ctable_t **);
-void change_char(struct ctable_t *, char *, struct termios *);
-void get_option(char *, struct termios *);
+/* PARALLEL APPLY */
+int run_jobs(glob_t *, struct sttyl_delta *, int);
+void * worker(void *);
+
+/* DAEMON MODE */
+int run_daemon(glob_t *, struct sttyl_delta *);
+void daemon_apply(char *, struct sttyl_delta *);
+void daemon_stop(int);
+int watch_dirs(int);
+char * watch_prefix(int);
+
+/* BATCH MODE */
+int run_batch(char *, struct sttyl_delta *, int);
+int batch_line(char *, char *, int, struct sttyl_delta *, int);
+int batch_tokens(char *, char **, int);
+void batch_error(char *, int, char *, char *, int);
+
+/* DEVICE CACHE */
+struct fdslot_t * cache_open(char *);
+int cache_apply(char *, struct sttyl_delta *, char **);
+int cache_show(char *, char **, int *);
+void cache_drop(struct fdslot_t *);
+void cache_forget(char *);
+void cache_close();
+
+/* DRIFT MONITOR */
+int run_watch(glob_t *, struct sttyl_delta *);
+int watch_open(int, struct wdev_t *, int);
+long long watch_clock();
+void check_drift(struct wdev_t *, struct sttyl_delta *);
+void show_drift(struct wdev_t *, struct termios *, struct termios *);
+
+/* PROFILES */
+void load_profile(char *, struct sttyl_delta *);
+int compile_profiles(char *, char *);
+int prof_cmp(const void *, const void *);
+
+/* SNAPSHOTS */
+int run_snapshot(glob_t *, char *);
+int snap_device(char *, int, char **, size_t *);
+int run_diff(char *);
+int diff_device(char *, struct sttyl_state *);
 
 /* TERMINAL FUNCTIONS */
-void get_settings(struct termios *);
-int set_settings(struct termios *);
-struct winsize get_term_size();
-int getbaud(int);
+int get_option(char **, struct sttyl_delta *);
+int get_when(char *);
+int get_flush(char *);
+int get_fields(char *);
+int get_count(char *, int);
+void tty_error(char *, char *, int);
+
+/* TRACING */
+void trace_report(char *, struct sttyl_trace *);
+void trace_summary();
+
+/* OUTPUT BUFFER */
+int out_report(char *, int, struct termios *);
+void out_printf(char *, ...);
+void out_flush();
 
 /* HELPER FUNCTIONS */
-void fatal(char *, char *);
-struct table_t * lookup(char *);
+void fatal(const char *, const char *);
 
 /* FILE-SCOPE VARIABLES*/
 static char *progname;			//used for error-reporting
+static int want_stats = NO;		//--stats given on command line
+static int format = STTYL_HUMAN;	//-g or --json given on command line
+static int fields = 0;			//--fields: STTYL_F_ bits, 0 for all
+static int show_names = NO;		//label reports with the device name
+static int njobs = 1;			//-j: threads for applying to devices
+static int daemon_mode = NO;	//--daemon: keep devices configured
+static volatile sig_atomic_t stopping = NO;	//--daemon: SIGTERM or SIGINT
+static char **patterns;			//-F and --devices, as given, for --daemon
+static int npatterns;
+static struct {int wd; char *prefix; } *watches;	//see watch_dirs()
+static int nwatches;
+static int watch_mode = NO;		//--watch: report drift from the settings
+static int interval = 60;		//--interval: seconds between full checks
+static char *batch = NULL;		//--batch: file of lines, "-" for stdin
+static char *snapshot = NULL;	//--snapshot: file to write, "-" for stdout
+static char *baseline = NULL;	//--diff: snapshot file to compare with
+static int tracing = NO;		//--trace: time the calls on each device
+static struct {struct sttyl_trace sum; int devices;
+			   char slowest[PATH_MAX]; double slowest_ns; } traced;
+												//see trace_report()
+static struct {int devices; int written; int skipped; } stats;
+static struct {char **names; int count; int kinds[NFAIL]; } failed;
+												//see add_failure()
+static struct {struct fdslot_t slots[FDCACHE]; unsigned long clock; } fdcache;
+												//see cache_open()
+static struct {char buf[OUTSIZE]; size_t len; } out;	//see out_printf()
 
 /*
  *	main()
- *	 Method: Load the current termios settings and process command-line
- *			 arguments. If none, it prints out the current values. Otherwise,
- *			 check for invalid/missing arguments, update the values, and set
- *			 the termios struct accordingly.
+ *	 Method: Parse the command-line arguments once into a delta and a list
+ *			 of devices. If no devices were named with -F or --devices,
+ *			 stdin is used, as before. Each device is then opened, and its
+ *			 settings either printed (no changes given) or updated with the
+ *			 same delta.
  *	 Return: 0 on success, 1 on error. If there is an invalid/missing
- *			 argument, the corresponding helper function will exit 1.
+ *			 argument, the corresponding helper function will exit 1. A
+ *			 device that fails does not stop the others: the run goes on,
+ *			 and ends with a summary of the failed devices (see
+ *			 show_failures()) and status 1.
  */
 int main(int ac, char *av[])
 {
-	struct termios ttyinfo;
-	get_settings(&ttyinfo);							//pull in current settings
+	struct sttyl_delta delta;						//parsed once, used per dev
+	glob_t devices;									//from -F and --devices
+	int nchanges, status;
+	size_t i;
+	struct sttyl_trace trace;
+	struct timespec parse_start, parse_end;
+
 	progname = *av;									//init to program name
-	struct ctable_t *c;								//for option processing
+	atexit(out_flush);								//write reports, even on
+													//an exit(1) error path
+
+	if (ac == 4 && strcmp(av[1], "--compile-profiles") == 0)
+		return compile_profiles(av[2], av[3]);		//text in, binary out
+	if (ac > 1 && strcmp(av[1], "--compile-profiles") == 0)
+	{
+		fprintf(stderr, "usage: %s --compile-profiles source output\n",
+				progname);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &parse_start);	//--trace not seen yet
+	nchanges = parse_args(av + 1, &delta, &devices);
+	clock_gettime(CLOCK_MONOTONIC, &parse_end);
+	sttyl_trace(tracing);
+	if (tracing == YES)
+		fprintf(stderr, "%s: trace: parse %.1fus\n", progname,
+				((parse_end.tv_sec - parse_start.tv_sec) * 1e9 +
+				 parse_end.tv_nsec - parse_start.tv_nsec) / 1000);
+
+	if (snapshot != NULL || baseline != NULL)		//binary -g, or diff
+	{
+		char *opt = snapshot != NULL ? "--snapshot" : "--diff";
+
+		if (nchanges > 0 || batch != NULL || daemon_mode == YES ||
+			watch_mode == YES || (snapshot != NULL && baseline != NULL))
+			fatal("cannot be used with settings or other modes:", opt);
+		if (baseline != NULL && devices.gl_pathc > 0)
+			fatal("takes the devices from the snapshot:", opt);
+		show_names = YES;
+		if (snapshot != NULL)
+			status = run_snapshot(&devices, snapshot);
+		else
+			status = run_diff(baseline);
+		return finish(&devices, status);
+	}
+
+	if (batch != NULL)								//devices from the lines
+	{
+		if (devices.gl_pathc > 0 || daemon_mode == YES || watch_mode == YES)
+			fatal("cannot be used with -F, --daemon, or --watch:", "--batch");
+		show_names = YES;
+		status = run_batch(batch, &delta, nchanges);
+		return finish(&devices, status);
+	}
+
+	if (daemon_mode == YES)							//until SIGTERM or SIGINT
+	{
+		if (npatterns == 0 || nchanges == 0)
+			fatal("needs devices (-F or --devices) and settings:", "--daemon");
+		return run_daemon(&devices, &delta);
+	}
 
-	if (ac == 1)									//no args, just progname
+	if (watch_mode == YES)							//never returns on success
 	{
-		show_tty(&ttyinfo);							//show default info
-		return 0;									//and stop
+		if (devices.gl_pathc == 0 || nchanges == 0)
+			fatal("needs devices (-F or --devices) and settings:", "--watch");
+		return run_watch(&devices, &delta);
 	}
 
-	while(*++av)
+	if (devices.gl_pathc == 0)						//no -F: classic behaviour
 	{
-		if( valid_char_opt(*av, &c) == YES )		//special-char option?
+		sttyl_trace_begin();
+		config_device("stdin", 0, &delta, nchanges);
+		sttyl_trace_end(&trace);
+		trace_report("stdin", &trace);
+	}
+	else
+		show_names = YES;
+
+	if (njobs > 1 && nchanges > 0 && devices.gl_pathc > 1)
+		return finish(&devices, run_jobs(&devices, &delta, njobs));
+
+	for(i = 0; i < devices.gl_pathc; i++)			//same changes, every dev
+	{
+		char *dev = devices.gl_pathv[i];
+		int fd;
+
+		sttyl_trace_begin();
+		if ( (fd = sttyl_open(dev)) == -1 )
 		{
-			if(av[1])								//check next arg exists
-			{
-				change_char(c, av[1], &ttyinfo);	//change it, or fatal()
-				av++;								//extra arg skip
-			}
+			tty_error(NULL, dev, errno);			//report device, go on
+			stats.devices++;
+			add_failure(dev, F_OPEN);
+		}
+		else
+		{
+			config_device(dev, fd, &delta, nchanges);
+			sttyl_close(fd);
+		}
+		sttyl_trace_end(&trace);
+		trace_report(dev, &trace);
+	}
+
+	return finish(&devices, 0);
+}
+
+/*
+ *	finish()
+ *	Purpose: End a run over devices: print the summaries and free the
+ *			 device list.
+ *	  Input: devices, the device list
+ *			 status, the exit status so far
+ *	 Return: The exit status: 1 if status was, or any device failed.
+ */
+int finish(glob_t *devices, int status)
+{
+	trace_summary();
+	globfree(devices);
+
+	if (want_stats == YES)
+		show_stats();
+	show_failures();
+
+	return (status != 0 || failed.count > 0) ? 1 : 0;
+}
+
+/*
+ *	parse_args()
+ *	Purpose: Walk the argument vector once, splitting it into device names
+ *			 and a delta of tty setting changes.
+ *	  Input: av, the NULL-terminated list of arguments (without progname)
+ *			 delta, the delta to compile the changes into
+ *			 devices, a glob_t to store the device list in
+ *	 Return: The number of settings parsed. On an invalid or missing argument
+ *			 fatal() is called and the program exits 1.
+ *	   Note: The devices glob_t is always initialized, so it is safe to pass
+ *			 to globfree() even if no devices were named.
+ */
+int parse_args(char **av, struct sttyl_delta *delta, glob_t *devices)
+{
+	int n = 0;
+
+	sttyl_init(delta);								//no changes yet
+	memset(devices, 0, sizeof(glob_t));				//empty device list
+
+	for( ; *av; av++)
+	{
+		if( strcmp(*av, "-F") == 0 || strcmp(*av, "--devices") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);	//no device given
+			add_devices(av[1], devices);
+			av++;									//extra arg skip
+		}
+		else if( strcmp(*av, "--stats") == 0 )
+			want_stats = YES;						//report at the end
+		else if( strcmp(*av, "--daemon") == 0 )
+			daemon_mode = YES;						//see run_daemon()
+		else if( strcmp(*av, "--watch") == 0 )
+			watch_mode = YES;						//see run_watch()
+		else if( strcmp(*av, "--trace") == 0 )
+			tracing = YES;							//see trace_report()
+		else if( strcmp(*av, "--verify") == 0 )
+			delta->verify = YES;					//read back, or roll back
+		else if( strcmp(*av, "--when") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);
+			if ( (delta->when = get_when(av[1])) == -1 )
+				fatal("invalid argument", av[1]);
+			av++;
+		}
+		else if( strcmp(*av, "--flush") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);
+			if ( (delta->flush = get_flush(av[1])) == -1 )
+				fatal("invalid argument", av[1]);
+			av++;
+			n++;									//an action on its own
+		}
+		else if( strcmp(*av, "--drain") == 0 )
+		{
+			delta->drain = YES;						//before any change
+			n++;
+		}
+		else if( strcmp(*av, "--interval") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);
+			interval = get_count(av[1], INT_MAX / 1000);	//epoll takes ms
+			av++;
+		}
+		else if( strcmp(*av, "--batch") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);	//no file given
+			batch = av[1];							//see run_batch()
+			av++;
+		}
+		else if( strcmp(*av, "--snapshot") == 0 ||
+				 strcmp(*av, "--diff") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);	//no file given
+			if (strcmp(*av, "--snapshot") == 0)
+				snapshot = av[1];					//see run_snapshot()
 			else
-				fatal("missing argument to", *av);	//no arg for special-char
+				baseline = av[1];					//see run_diff()
+			av++;
+		}
+		else if( strcmp(*av, "-j") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);
+			njobs = get_count(av[1], INT_MAX);		//or fatal()
+			av++;
+		}
+		else if( strcmp(*av, "-g") == 0 || strcmp(*av, "--save") == 0 )
+			format = STTYL_SAVE;						//stty-readable form
+		else if( strcmp(*av, "--json") == 0 )
+			format = STTYL_JSON;
+		else if( strcmp(*av, "--fields") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);
+			fields = get_fields(av[1]);				//or fatal()
+			av++;
+		}
+		else if( strcmp(*av, "--profile") == 0 )
+		{
+			if (av[1] == NULL)
+				fatal("missing argument to", *av);	//no profile given
+			load_profile(av[1], delta);				//merge it in, or fatal()
+			av++;
+			n++;
+		}
+		else										//a flag or special char
+		{
+			av += get_option(av, delta);			//skip any extra arg
+			n++;
 		}
-		else										//a different attribute
-			get_option(*av, &ttyinfo);
 	}
 
-	return set_settings(&ttyinfo);			//exit 1 on error, 0 on success
+	return n;
 }
 
 /*
- *	show_tty()
- *	Purpose: display the current settings for the tty.
- *	  Input: info, the struct containing the terminal information
- *	 Output: A collection of settings, separated by ';' and sorted by type.
- *	 Errors: get_term_size() will exit(1) if it encounters an error.
+ *	add_devices()
+ *	Purpose: Append one or more devices to the device list.
+ *	  Input: list, a comma-separated list of device paths or glob patterns,
+ *			 e.g. "/dev/ttyS*,/dev/ttyUSB0"
+ *			 devices, the glob_t to append the matches to
+ *	 Errors: A pattern that matches nothing is kept as-is (GLOB_NOCHECK),
+ *			 so the open() in main() reports the missing device by name.
  */
-void show_tty(struct termios *info)
+void add_devices(char *list, glob_t *devices)
 {
-	//get terminal size and baud speed
-	struct winsize w = get_term_size();		//exit 1 if error getting size
-	int baud = getbaud(cfgetospeed(info));
+	char *copy, *pattern, *save;
+	int flags = GLOB_NOCHECK | (devices->gl_pathv ? GLOB_APPEND : 0);
+
+	if ( (copy = strdup(list)) == NULL )
+		fatal("out of memory parsing", list);
+
+	for(pattern = strtok_r(copy, ",", &save); pattern != NULL;
+		pattern = strtok_r(NULL, ",", &save))
+	{
+		if (glob(pattern, flags, NULL, devices) != 0)
+			fatal("cannot expand device list", pattern);
+		flags |= GLOB_APPEND;						//keep earlier matches
 
-	//print info
-	printf("speed %d baud; ", baud);		//baud speed
-	printf("rows %d; ", w.ws_row);			//rows
-	printf("cols %d;\n", w.ws_col);			//cols
-	show_charset(info);						//special characters
-	show_flagset(info);						//current flag states
+		//remember the pattern itself, for devices that appear later
+		patterns = realloc(patterns, (npatterns + 1) * sizeof(char *));
+		if (patterns == NULL || (patterns[npatterns++] = strdup(pattern))
+			== NULL)
+			fatal("out of memory parsing", list);
+	}
 
+	free(copy);
 	return;
 }
 
 /*
- *	show_charset()
- *	Purpose: Print the list of special characters and their current values.
- *	  Input: info, the struct containing terminal information
- *	 Output: A header identifying output as "cchars: ", followed by
- *			 ';' delimited "type = char" values.
- *	 Method: For disabled values, as denoted by _POSIX_VDISABLE, print
- *			 "<undef>" (courtesy of the 2019-03-13 section by Brandon
- *			 Williams). For unprintable values, use ^X notation, where X
- *			 is the value XORed with the CHAR_MASK, 64 or ASCII '@'. In
- *			 practice, this adds 64 to values 0-31 and subtracts 64 from
- *			 value 127, the DEL char (This idea was mentioned in piazza
- *			 post @171.). For all other values, they are printable ASCII.
- *	   Note: Unlike the struct for flags, which stores the type of flag
- *			 the array, the cchars does not since its identity is defined
- *			 by its unique table. In this case, for printing out a header,
- *			 the value of "cchars: " is coded into the print statement rather
- *			 than a variable.
+ *	config_device()
+ *	Purpose: Show or update the settings of one open tty.
+ *	  Input: name, the device name used in error messages
+ *			 fd, the open file descriptor for the device
+ *			 delta, the parsed changes to apply
+ *			 n, the number of settings parsed; if 0, print current settings
+ *	 Return: 0, or -1 if the device failed.
+ *	 Errors: On failure, a message is output to stderr, and the device is
+ *			 recorded for show_failures().
  */
-void show_charset(struct termios *info)
+int config_device(char *name, int fd, struct sttyl_delta *delta, int n)
 {
-	int i;
+	struct termios current;
+	char *step;
+	int changed;
+
+	stats.devices++;
 
-	//iterate through the cchars table (defined at top)
-	for(i = 0; cchars[i].c_name != NULL; i++)
+	if (n == 0)										//no changes, just show
 	{
-		//if the first value, print a header
-		if(i == 0)
-			printf("cchars: ");
+		if ( sttyl_get(fd, &current) == -1 )		//pull in current settings
+		{
+			tty_error("cannot get tty info for", name, errno);
+			return add_failure(name, F_READ);
+		}
+		if ( out_report(name, fd, &current) == -1 )
+		{
+			fprintf(stderr, "could not get window size%s%s\n",
+					show_names == YES ? " for " : "",
+					show_names == YES ? name : "");
+			return add_failure(name, F_REPORT);
+		}
+		return 0;
+	}
+
+	if ( (changed = sttyl_apply(fd, delta, &step)) == -1 )
+	{
+		tty_error(step, name, errno);
+		return add_failure(name, F_APPLY);
+	}
+
+	if (changed == YES)
+		stats.written++;
+	else
+		stats.skipped++;
+
+	return 0;
+}
+
+/*
+ *	run_jobs()
+ *	Purpose: Apply a delta to many devices using a pool of threads.
+ *	  Input: devices, the device list
+ *			 delta, the parsed changes to apply
+ *			 nthreads, the most threads to start
+ *	 Return: 0 if every device was updated, otherwise 1.
+ *	 Method: Each thread takes the next device from the list, and does its
+ *			 own open(), sttyl_apply(), and close(), so a slow driver holds up
+ *			 one thread rather than the whole run. The results are kept per
+ *			 device and reported in list order after all threads are done,
+ *			 so the output does not depend on timing. A failed device does
+ *			 not stop the others.
+ */
+int run_jobs(glob_t *devices, struct sttyl_delta *delta, int nthreads)
+{
+	struct pool_t pool;
+	pthread_t *tids;
+	int i, started, status = 0;
+	size_t j;
+
+	pool.njobs = devices->gl_pathc;
+	pool.next = 0;
+	pool.delta = delta;
+	pthread_mutex_init(&pool.lock, NULL);
+	if ( (pool.jobs = calloc(pool.njobs, sizeof(struct job_t))) == NULL ||
+		 (tids = calloc(nthreads, sizeof(pthread_t))) == NULL )
+		fatal("out of memory for", "-j");
+
+	for(j = 0; j < pool.njobs; j++)
+		pool.jobs[j].name = devices->gl_pathv[j];
+
+	if ((size_t)nthreads > pool.njobs)				//no idle threads
+		nthreads = pool.njobs;
 
-		//get value from termios struct for the current cchar
-		cc_t value = info->c_cc[cchars[i].c_value];
+	for(started = 0; started < nthreads; started++)
+		if (pthread_create(&tids[started], NULL, worker, &pool) != 0)
+			break;
+	if (started == 0)								//no threads at all
+		worker(&pool);
+	for(i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
 
-		//print the name and corresponding value, see "Method" above
-		if (value == _POSIX_VDISABLE)
-			printf("%s = <undef>; ", cchars[i].c_name);
-		else if(iscntrl(value))
-			printf("%s = ^%c; ", cchars[i].c_name, value ^ CHAR_MASK);
+	for(j = 0; j < pool.njobs; j++)					//report in order
+	{
+		struct job_t *job = &pool.jobs[j];
+
+		stats.devices++;
+		trace_report(job->name, &job->trace);
+		if (job->result == -1)
+		{
+			tty_error(job->step, job->name, job->err);
+			add_failure(job->name, job->step == NULL ? F_OPEN : F_APPLY);
+			status = 1;
+		}
+		else if (job->result == YES)
+			stats.written++;
 		else
-			printf("%s = %c; ", cchars[i].c_name, value);
+			stats.skipped++;
 	}
 
-	return;
+	pthread_mutex_destroy(&pool.lock);
+	free(pool.jobs);
+	free(tids);
+	return status;
 }
 
 /*
- *	show_flagset()
- *	Purpose: Print the current state of terminal flags.
- *	  Input: info, the struct containing terminal information
- *	 Output: For each flag type (e.g. iflags, oflags, etc.), print a header
- *			 for each, followed by a space-delimited list of the flags. A
- *			 leading dash signifies that flag is OFF, otherwise it is ON.
- *			 Each flag type starts a new line.
- *	 Method: Iterate through the table containing all terminal flags. If
- *			 the flag is the first of its type, store the flag type and
- *			 print it as a header, with a new line, a la the macOS version
- *			 of stty. Then, using the offset stored in the table, go to the
- *			 correct place in the termios struct to compare with the current
- *			 flag value.
+ *	worker()
+ *	Purpose: Thread body for run_jobs(): update devices until none are left.
+ *	  Input: arg, the shared struct pool_t
+ *	 Return: NULL. The result for each device is stored in its job.
  */
-void show_flagset(struct termios * info)
+void * worker(void *arg)
 {
-	int i;
-	char * type = NULL;
+	struct pool_t *pool = arg;
+	struct job_t *job;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pool->lock);			//claim the next device
+		job = pool->next < pool->njobs ? &pool->jobs[pool->next++] : NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (job == NULL)
+			return NULL;
+
+		sttyl_trace_begin();						//this thread's trace
+		job->result = sttyl_apply_path(job->name, pool->delta, &job->step);
+		job->err = errno;
+		sttyl_trace_end(&job->trace);
+	}
+}
 
-	//iterate through the table of flags (defined at top)
-	for(i = 0; table[i].name != NULL; i++)
+/*
+ *	run_daemon()
+ *	Purpose: Keep devices configured: apply the delta to the devices that
+ *			 exist now, then again to every matching device that appears.
+ *	  Input: devices, the devices that matched when sttyl started
+ *			 delta, the parsed changes to apply
+ *	 Return: 0 when stopped by SIGTERM or SIGINT, or 1 if inotify cannot be
+ *			 set up or read.
+ *	 Method: The directories of all -F and --devices patterns are watched
+ *			 with inotify. When a name is created, moved in, or has its
+ *			 attributes changed (udev setting the permissions), the full
+ *			 path is checked against the patterns with fnmatch(), and the
+ *			 delta applied to it. The delta is kept in memory, so nothing is
+ *			 parsed or spawned per event, and sttyl_apply() skips devices
+ *			 that are already set. Errors are reported and the daemon keeps
+ *			 going. It stays in the foreground, for a service manager, and
+ *			 the stop signals are only let in while it waits in pselect(),
+ *			 so one cannot land between a device's open() and close().
+ *	   Note: udev creates a device and then sets its permissions, so one
+ *			 read() often brings several events for the same device. They
+ *			 share one open() and tcgetattr() through the cache, which is
+ *			 closed again after each read(): a daemon holding ports open
+ *			 would keep hupcl from hanging up when their real users close
+ *			 them, and would miss changes those users make.
+ */
+int run_daemon(glob_t *devices, struct sttyl_delta *delta)
+{
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	struct sigaction sa;
+	fd_set ready;
+	sigset_t stop, waiting;
+	ssize_t len, off;
+	size_t i;
+	int fd;
+
+	if ( (fd = inotify_init1(IN_CLOEXEC)) == -1 || watch_dirs(fd) == -1 )
+	{
+		perror("cannot watch for devices");
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_stop;
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGTERM);
+	sigaddset(&stop, SIGINT);
+	sigprocmask(SIG_BLOCK, &stop, &waiting);		//waiting: let them in
+	sigdelset(&waiting, SIGTERM);
+	sigdelset(&waiting, SIGINT);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	for(i = 0; i < devices->gl_pathc; i++)			//the ones already there
+		if (access(devices->gl_pathv[i], F_OK) == 0)
+			daemon_apply(devices->gl_pathv[i], delta);
+	cache_close();
+
+	for(;;)
 	{
-		//If the first a given type, store the flag type and print as header
-		if(type == NULL || strcmp(type, table[i].type) != 0)
+		FD_ZERO(&ready);
+		FD_SET(fd, &ready);
+		if (pselect(fd + 1, &ready, NULL, NULL, NULL, &waiting) == -1 &&
+			errno != EINTR)
+		{
+			perror("waiting for inotify events");
+			return 1;
+		}
+		if (stopping == YES)
+			return 0;								//nothing is held open
+		if ( (len = read(fd, buf, sizeof(buf))) <= 0 )
 		{
-			type = table[i].type;				//switch to new flag type
-			printf("\n%ss: ", type);			//print extra 's' to header
+			if (len == -1 && errno == EINTR)
+				continue;
+			perror("reading inotify events");
+			return 1;
 		}
 
-		//get the pointer to termios struct stored in "entry"
-		tcflag_t * mode_p = (tcflag_t *)((char *)(info) + table[i].mode);
+		for(off = 0; off < len; )					//each event in the read
+		{
+			struct inotify_event *ev = (struct inotify_event *)(buf + off);
+			off += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->len == 0 || (ev->mask & IN_ISDIR))
+				continue;
 
-		//check if the flag is ON or OFF
-		if ((*mode_p & table[i].flag) == table[i].flag)
-			printf("%s ", table[i].name);		//if ON, just print
-		else
-			printf("-%s ", table[i].name);		//if OFF, add '-'
+			snprintf(path, PATH_MAX, "%s%s", watch_prefix(ev->wd), ev->name);
+			for(i = 0; i < (size_t)npatterns; i++)
+			{
+				if (fnmatch(patterns[i], path, FNM_PATHNAME) == 0)
+				{
+					if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+						cache_forget(path);			//a new device there
+					daemon_apply(path, delta);
+					break;
+				}
+			}
+		}
+		cache_close();								//hold nothing open idle
 	}
+}
+
+/*
+ *	daemon_apply()
+ *	Purpose: Apply the delta to one device for run_daemon(), and log it.
+ *	  Input: name, the path of the device
+ *			 delta, the parsed changes to apply
+ *	 Output: A line on stderr when the device was changed, or the error if
+ *			 it could not be. Nothing if it was already set.
+ */
+void daemon_apply(char *name, struct sttyl_delta *delta)
+{
+	struct sttyl_trace trace;
+	char *step;
+	int result;
 
-	//if printed flags were printed, add a tailing newline
-	if (i > 0)
-		printf("\n");
+	sttyl_trace_begin();
+	result = cache_apply(name, delta, &step);
+	sttyl_trace_end(&trace);
+
+	if (result == -1)
+		tty_error(step, name, errno);
+	else if (result == YES)
+		fprintf(stderr, "%s: configured %s\n", progname, name);
+	trace_report(name, &trace);
 
 	return;
 }
 
 /*
- *	valid_char_opt()
- *	Purpose: Check to see if an argument matches one of the special chars.
- *	  Input: arg, the option to check
- *			 c, a pointer to store the struct that matched
- *	 Return: YES, if the arg was found in the cchars table. Otherwise, NO.
+ *	daemon_stop()
+ *	Purpose: The SIGTERM and SIGINT handler for run_daemon().
  */
-int valid_char_opt(char * arg, struct ctable_t **c)
+void daemon_stop(int sig)
 {
-	int i;
+	(void)sig;
+	stopping = YES;
+	return;
+}
+
+/*
+ *	watch_dirs()
+ *	Purpose: Add an inotify watch on the directory of each device pattern.
+ *	  Input: fd, the inotify descriptor
+ *	 Return: The number of directories watched, or -1 if none could be.
+ *	 Method: The directory is the part of the pattern before the last '/'
+ *			 ("." if there is none). inotify gives the same watch for the
+ *			 same directory, so each one is only stored once; the stored
+ *			 prefix turns an event's name back into a path that matches the
+ *			 pattern. A directory that cannot be watched (e.g. it has a
+ *			 wildcard in it) is reported and skipped.
+ */
+int watch_dirs(int fd)
+{
+	int i, j, wd;
+	char dir[PATH_MAX], prefix[PATH_MAX], *slash;
 
-	for(i = 0; cchars[i].c_name != NULL; i++)	//go through all char options
+	for(i = 0; i < npatterns; i++)
 	{
-		if(strcmp(arg, cchars[i].c_name) == 0)	//if it matches arg requested
+		snprintf(dir, PATH_MAX, "%s", patterns[i]);
+		if ( (slash = strrchr(dir, '/')) == NULL )
+		{
+			strcpy(dir, ".");						//"ttyS*": in ., no prefix
+			prefix[0] = '\0';
+		}
+		else
+		{
+			slash[1] = '\0';						//"/dev/ttyS*" -> "/dev/"
+			strcpy(prefix, dir);
+			if (slash != dir)						//watch "/dev", keep "/"
+				*slash = '\0';
+		}
+
+		wd = inotify_add_watch(fd, dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+		if (wd == -1)
 		{
-			*c = &cchars[i];					//store ptr to that struct
-			return YES;							//return YES
+			tty_error("cannot watch", dir, errno);
+			continue;
 		}
+
+		for(j = 0; j < nwatches && watches[j].wd != wd; j++)
+			;
+		if (j < nwatches)							//already watching it
+			continue;
+
+		watches = realloc(watches, (nwatches + 1) * sizeof(watches[0]));
+		if (watches == NULL)
+			fatal("out of memory for", "--daemon");
+		watches[nwatches].wd = wd;
+		if ( (watches[nwatches++].prefix = strdup(prefix)) == NULL )
+			fatal("out of memory for", "--daemon");
+	}
+
+	if (nwatches == 0)
+	{
+		errno = ENOENT;
+		return -1;
 	}
 
-	return NO;
+	return nwatches;
 }
 
 /*
- *	change_char()
- *	Purpose: Update a control char -- "erase" or "kill" are accepted.
- *	  Input: c, the struct containing the index to update
- *			 value, the command-line to arg containing the new char
- *			 info, the struct containing terminal information
- *	 Errors: If the "value" argument is more than 1-char long, it is
- *			 invalid, so print error and exit 1.
- *	   Note: Bullet #2 in the assignment handout mentions the program is
- *			 not required to handle caret-letter input. If it did, this
- *			 is where it would be implemented.
+ *	watch_prefix()
+ *	Purpose: Find the path prefix for an inotify watch.
+ *	  Input: wd, the watch descriptor from an event
+ *	 Return: The prefix, e.g. "/dev/", or "" for the current directory.
  */
-void change_char(struct ctable_t * c, char *value, struct termios *info)
+char * watch_prefix(int wd)
 {
-	if (strlen(value) > 1 || ! isascii(value[0]))	//not an acceptable char
-		fatal("invalid integer argument", value);	//exit
+	int i;
 
-	info->c_cc[c->c_value] = value[0];				//set the value
+	for(i = 0; i < nwatches; i++)
+		if (watches[i].wd == wd)
+			return watches[i].prefix;
 
-	return;
+	return "";
 }
 
 /*
- *	get_option()
- *	Purpose: Turn the given option on/off in the termios struct.
- *	  Input: option, the argument to check and turn on/off
- *	 Return: If the option is not found in the table, fatal() is called
- *			 to print an error message and exit 1. Otherwise, the flag
- *			 is set to ON or OFF.
+ *	run_batch()
+ *	Purpose: Configure many devices from lines of "device settings...", in
+ *			 one process.
+ *	  Input: path, the file to read, or "-" for stdin
+ *			 base, the settings from the command line, used on every line
+ *			 nbase, the number of them
+ *	 Return: 0 if every line was applied, otherwise 1.
+ *	 Method: The input is read in BATCHBUF chunks and streamed: each whole
+ *			 line in the buffer is handed to batch_line(), which splits it
+ *			 into words in place, so no line or word is copied. The part
+ *			 line left at the end of a chunk is moved to the front and the
+ *			 next read() fills in the rest. A line longer than the buffer is
+ *			 reported and skipped up to its newline.
+ *	 Errors: A bad line is reported, with its line number, and the run goes
+ *			 on with the next one. Only failing to open or read the input
+ *			 itself is fatal.
  */
-void get_option(char *option, struct termios *info)
+int run_batch(char *path, struct sttyl_delta *base, int nbase)
 {
-	int status = ON;
-	char * original = option;					//"store" the original
-	struct table_t * entry = NULL;				//place to put flag info
+	static char buf[BATCHBUF + 1];					//+1: a last '\0'
+	char *src = strcmp(path, "-") == 0 ? "stdin" : path, *nl;
+	size_t len = 0, start;
+	ssize_t n;
+	int fd = 0, lineno = 0, status = 0, skipping = NO;
 
-	if(option[0] == '-')						//check if a leading dash
+	if (strcmp(path, "-") != 0 && (fd = open(path, O_RDONLY)) == -1)
+		fatal(strerror(errno), path);
+
+	for(;;)
 	{
-		status = OFF;							//will turn option off
-		option++;								//trim dash from option
+		if ( (n = read(fd, buf + len, BATCHBUF - len)) == -1 )
+		{
+			if (errno == EINTR)
+				continue;
+			fatal(strerror(errno), src);
+		}
+		len += n;
+
+		for(start = 0; (nl = memchr(buf + start, '\n', len - start)) != NULL;
+			start = nl + 1 - buf)
+		{
+			*nl = '\0';								//one line, in place
+			lineno++;
+			if (skipping == NO &&
+				batch_line(buf + start, src, lineno, base, nbase) == -1)
+				status = 1;
+			skipping = NO;
+		}
+
+		if (n == 0)									//end of input
+		{
+			buf[len] = '\0';						//last line, no newline
+			if (start < len && skipping == NO &&
+				batch_line(buf + start, src, ++lineno, base, nbase) == -1)
+				status = 1;
+			break;
+		}
+
+		if (start == 0 && len == BATCHBUF)			//longer than the buffer
+		{
+			if (skipping == NO)
+				batch_error(src, lineno + 1, "line too long", NULL, 0);
+			status = 1;
+			skipping = YES;
+			len = 0;
+			continue;
+		}
+
+		memmove(buf, buf + start, len - start);		//keep the part line
+		len -= start;
 	}
 
-	if ( (entry = lookup(option)) == NULL)		//lookup appropriate flag
-		fatal("illegal argument", original);	//couldn't find it, exit
+	cache_close();
+	if (fd != 0)
+		close(fd);
+	return status;
+}
+
+/*
+ *	batch_line()
+ *	Purpose: Parse and apply one line of --batch input.
+ *	  Input: line, the line, without its newline; it is split in place
+ *			 src, lineno, where it came from, for messages
+ *			 base, nbase, the settings given on the command line
+ *	 Return: 0 if the line was applied (or is blank, or a '#' comment),
+ *			 -1 if it was reported as an error.
+ *	 Method: The first word is the device, and the rest are parsed by
+ *			 sttyl_parse() on top of a copy of the command-line settings,
+ *			 so each line means what "sttyl -F device words..." would. A
+ *			 bad setting skips the whole line, so a device is never left
+ *			 half configured. A line with only a device and no settings
+ *			 anywhere shows it, as sttyl -F does. Devices are opened
+ *			 through the cache, so one named on several lines is opened
+ *			 and read once.
+ */
+int batch_line(char *line, char *src, int lineno, struct sttyl_delta *base,
+			   int nbase)
+{
+	char *args[BATCHARGS], *step = NULL;
+	struct sttyl_delta delta = *base;
+	struct sttyl_err err;
+	struct sttyl_trace trace;
+	int n, i, result = 0, kind;
+
+	if ( (n = batch_tokens(line, args, BATCHARGS)) == -1 )
+	{
+		batch_error(src, lineno, "too many settings", NULL, 0);
+		return -1;
+	}
+	if (n == 0 || args[0][0] == '#')				//blank or comment
+		return 0;
 
-	//store pointer to termios struct stored in "entry"
-	tcflag_t * mode_p = (tcflag_t *)((char *)(info) + entry->mode);
+	for(i = 1; i < n; i++)							//same as the command line
+	{
+		if ( (result = sttyl_parse(&args[i], &delta, &err)) == -1 )
+		{
+			fprintf(stderr, "%s: %s:%d: %s `%s'\n", progname, src, lineno,
+					err.msg, err.arg);
+			stats.devices++;
+			return add_failure(args[0], F_PARSE);
+		}
+		i += result;
+	}
 
-	if(status == ON)
-		*mode_p |= entry->flag;					//turn ON
+	stats.devices++;
+	sttyl_trace_begin();
+	if (n == 1 && nbase == 0)						//no changes, just show
+	{
+		result = cache_show(args[0], &step, &kind);
+	}
 	else
-		*mode_p &= ~entry->flag;				//turn OFF
+	{
+		result = cache_apply(args[0], &delta, &step);
+		kind = step == NULL ? F_OPEN : F_APPLY;
+		if (result == YES)
+			stats.written++;
+		else if (result == NO)
+			stats.skipped++;
+	}
+	sttyl_trace_end(&trace);
+	trace_report(args[0], &trace);
 
-	return;
+	if (result == -1)
+	{
+		batch_error(src, lineno, step, args[0], errno);
+		return add_failure(args[0], kind);
+	}
+	return 0;
 }
 
 /*
- *	lookup()
- *	Purpose: Find a given option in the defined tables.
- *	  Input: option, the argument we are searching for
- *	 Return: A pointer to the corresponding flag, if a match is found.
- *			 Otherwise, NULL is returned to indicate failure.
+ *	batch_tokens()
+ *	Purpose: Split a line into words, in place.
+ *	  Input: p, the line; the blank after each word is overwritten with '\0'
+ *			 args, where to store the words, followed by NULL
+ *			 max, the size of args
+ *	 Return: The number of words, or -1 if there are more than max - 1.
+ *	   Note: Words are separated by spaces, tabs, or a '\r' from a file
+ *			 written on Windows. There is no quoting; settings never need it.
  */
-struct table_t * lookup(char *option)
+int batch_tokens(char *p, char **args, int max)
 {
-	int i;
-	for (i = 0; table[i].name != NULL; i++)
+	int n = 0;
+
+	for(;;)
 	{
-		//option matched table entry
-		if(strcmp(option, table[i].name) == 0)
-			return &table[i];
+		p += strspn(p, " \t\r");					//skip blanks
+		if (*p == '\0')
+			break;
+		if (n == max - 1)
+			return -1;
+
+		args[n++] = p;
+		p += strcspn(p, " \t\r");					//end of the word
+		if (*p != '\0')
+			*p++ = '\0';
 	}
 
-	return NULL;
+	args[n] = NULL;
+	return n;
 }
 
 /*
- *	fatal()
- *	Purpose: Print message to stderr and exit.
- *	  Input: err, the type of error that was encounters
- *			 arg, the value of the argument that caused a problem
- *	 Return: Exit with 1.
+ *	batch_error()
+ *	Purpose: Report an error on one line of --batch input.
+ *	  Input: src, lineno, the input and line it was on
+ *			 step, what failed, e.g. "Setting attributes for"; NULL with a
+ *			 device name means it could not be opened
+ *			 name, the device, or NULL if step is the whole message
+ *			 err, the errno value, if name is given
+ *	 Output: On stderr, "progname: src:line: " and then the message as
+ *			 tty_error() would give it, e.g.
+ *			 "sttyl: lines.txt:12: Setting attributes for /dev/ttyS4: I/O
+ *			 error"
  */
-void fatal(char *err, char *arg)
+void batch_error(char *src, int lineno, char *step, char *name, int err)
 {
-	fprintf(stderr, "%s: %s `%s'\n", progname, err, arg);
-	exit(1);
+	fprintf(stderr, "%s: %s:%d: ", progname, src, lineno);
+	if (name == NULL)
+		fprintf(stderr, "%s\n", step);
+	else if (step == NULL)
+		fprintf(stderr, "%s `%s'\n", strerror(err), name);
+	else
+		fprintf(stderr, "%s %s: %s\n", step, name, strerror(err));
+	return;
 }
 
 /*
- *	get_term_size()
- *	Purpose: Get the current size of the terminal, in rows and cols.
- *	 Return: On error, message output to stderr and exit 1. Otheriwse,
- *			 ioctl() stores the winsize struct in "w" and returns that.
- *	   Note: ioctl() values copied from termfuncs.c from the more03
- *			 assignment files at the beginning of class.
+ *	cache_open()
+ *	Purpose: Find a device in the cache, or open it and add it.
+ *	  Input: name, the path of the device
+ *	 Return: The device's slot, or NULL with errno set if it cannot be
+ *			 opened.
+ *	 Method: A linear search, as there are only FDCACHE slots; a hit is
+ *			 marked as just used. A miss takes an empty slot, or closes the
+ *			 least recently used device to free one. The device is opened
+ *			 by sttyl_open(), with O_NONBLOCK and O_NOCTTY, and its settings
+ *			 are not read until they are needed (known is NO).
  */
-struct winsize get_term_size()
+struct fdslot_t * cache_open(char *name)
 {
-	struct winsize w;
+	struct fdslot_t *slot, *lru = &fdcache.slots[0];
+	int i, fd;
 
-	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0)
+	for(i = 0; i < FDCACHE; i++)
 	{
-		fprintf(stderr, "could not get window size\n");
-		exit(1);
+		slot = &fdcache.slots[i];
+		if (slot->name != NULL && strcmp(slot->name, name) == 0)
+		{
+			slot->used = ++fdcache.clock;			//a hit: no open()
+			return slot;
+		}
+		if (lru->name != NULL &&					//empty, or older
+			(slot->name == NULL || slot->used < lru->used))
+			lru = slot;
 	}
 
-	return w;
+	if ( (fd = sttyl_open(name)) == -1 )
+		return NULL;
+	if (lru->name != NULL)							//make room
+		cache_drop(lru);
+	if ( (lru->name = strdup(name)) == NULL )
+		fatal("out of memory for", name);
+	lru->fd = fd;
+	lru->known = NO;
+	lru->used = ++fdcache.clock;
+	return lru;
 }
 
 /*
- *	get_settings()
- *	Purpose: Retrieve the current terminal settings.
- *	  Input: info, the struct to store terminal information
- *	 Return: On error, message output to stderr and exit 1. Otherwise,
- *			 tcgetattr() stores the information in the struct passed in.
+ *	cache_apply()
+ *	Purpose: Apply a delta to a device, through the cache.
+ *	  Input: name, the path of the device
+ *			 delta, the parsed changes to apply
+ *			 step, where to store what failed, on error
+ *	 Return: As sttyl_apply_path().
+ *	 Method: sttyl_apply_from() is given the settings kept in the slot,
+ *			 which it brings up to date, so only the first use of a device
+ *			 reads them. After a write without --verify, the slot has what
+ *			 was asked for, not what the driver kept (it may round a rate,
+ *			 or drop a character size it lacks), so they are marked unknown
+ *			 and read again at the next use. A device kept open that fails
+ *			 with EIO has been hung up or unplugged since; it is opened
+ *			 again and the delta tried once more. On any other error the
+ *			 device is dropped from the cache, since its settings are no
+ *			 longer known.
  */
-void get_settings(struct termios *info)
+int cache_apply(char *name, struct sttyl_delta *delta, char **step)
 {
-	if ( tcgetattr(0, info) == -1 )
+	struct fdslot_t *slot;
+	int result, err, reused, tries = 0;
+
+	do
 	{
-		perror("cannot get tty info for stdin");
-		exit(1);
-	}
+		*step = NULL;								//NULL: failed to open
+		if ( (slot = cache_open(name)) == NULL )
+			return -1;
+		reused = slot->known;						//kept from before
 
-	return;
+		if (slot->known == NO && sttyl_get(slot->fd, &slot->info) == -1)
+		{
+			*step = "cannot get tty info for";
+			result = -1;
+		}
+		else
+			result = sttyl_apply_from(slot->fd, delta, &slot->info, step);
+
+		if (result != -1)
+		{
+			slot->known = result == NO || delta->verify == YES;	//read back
+			return result;
+		}
+		err = errno;
+		cache_drop(slot);
+		errno = err;
+	} while (reused == YES && err == EIO && tries++ == 0);
+
+	return -1;
 }
 
 /*
- *	set_settings()
- *	Purpose: Apply changes to the terminal settings.
- *	  Input: info, the struct containing terminal information
- *	 Return: 0 on success, 1 on error. If an error, message will be
- *			 output to stderr.
+ *	cache_show()
+ *	Purpose: Show the settings of a device, through the cache.
+ *	  Input: name, the path of the device
+ *			 step, kind, where to store what failed, and the F_ stage, on
+ *			 error
+ *	 Return: 0, or -1 with errno set. If the device cannot be opened, *step
+ *			 is NULL.
+ *	   Note: The settings are read only if the cache does not know them:
+ *			 a device shown just after it was set with --verify, or found
+ *			 already set, is shown as it was read then; otherwise they are
+ *			 read again (see cache_apply()).
  */
-int set_settings(struct termios *info)
+int cache_show(char *name, char **step, int *kind)
 {
-	if ( tcsetattr( 0, TCSANOW, info ) == -1 )
+	struct fdslot_t *slot;
+	int err;
+
+	*step = NULL;
+	*kind = F_OPEN;
+	if ( (slot = cache_open(name)) == NULL )
+		return -1;
+
+	if (slot->known == NO && sttyl_get(slot->fd, &slot->info) == -1)
+	{
+		*step = "cannot get tty info for";
+		*kind = F_READ;
+	}
+	else if (out_report(name, slot->fd, &slot->info) == -1)
+	{
+		*step = "could not get window size for";
+		*kind = F_REPORT;
+	}
+	else
 	{
-		perror("Setting attributes");
-		exit(1);
+		slot->known = YES;
+		return 0;
 	}
 
-	return 0;
+	err = errno;
+	cache_drop(slot);
+	errno = err;
+	return -1;
 }
 
 /*
- *	getbaud()
- *	Purpose: Convert a speed_t value into the corresponding baud value.
- *	  Input: speed, the speed_t value stored in the termios struct
- *	 Return: The speed converted to an int.
- *	  Notes: The base of the code was copied from the showtty.c file from
- *			 the lecture materials for week 5. Minor modifications have
- *			 been made, adding more values according to the standards found
- *			 at the link below.
- *
- *	http://pubs.opengroup.org/onlinepubs/007904975/basedefs/termios.h.html
- */
-int getbaud(int speed)
-{
-	switch(speed)
-	{
-		case B0:		return 0;		break;
-		case B50:		return 50;		break;
-		case B75:		return 75;		break;
-		case B110:		return 110;		break;
-		case B134:		return 134;		break;
-		case B150:		return 150;		break;
-		case B200:		return 200;		break;
-		case B300:		return 300;		break;
-		case B600:		return 600;		break;
-		case B1200:		return 1200;	break;
-		case B1800:		return 1800;	break;
-		case B2400:		return 2400;	break;
-		case B4800:		return 4800;	break;
-		case B9600:		return 9600;	break;
-		case B19200:	return 19200;	break;
-		case B38400:	return 38400;	break;
-		default:
-			perror("failed to get baud speed");
-			exit(1);
-	}
+ *	cache_drop(), cache_forget(), cache_close()
+ *	Purpose: Close one cached device, the one with a given path if it is
+ *			 cached (e.g. a new device has appeared there), or all of them.
+ */
+void cache_drop(struct fdslot_t *slot)
+{
+	sttyl_close(slot->fd);
+	free(slot->name);
+	slot->name = NULL;
+	return;
+}
+
+void cache_forget(char *name)
+{
+	int i;
+
+	for(i = 0; i < FDCACHE; i++)
+		if (fdcache.slots[i].name != NULL &&
+			strcmp(fdcache.slots[i].name, name) == 0)
+			cache_drop(&fdcache.slots[i]);
+	return;
+}
+
+void cache_close()
+{
+	int i;
+
+	for(i = 0; i < FDCACHE; i++)
+		if (fdcache.slots[i].name != NULL)
+			cache_drop(&fdcache.slots[i]);
+	return;
+}
+
+/*
+ *	run_watch()
+ *	Purpose: Monitor devices, reporting when their settings drift from
+ *			 the ones given on the command line.
+ *	  Input: devices, the devices to monitor
+ *			 delta, the expected settings
+ *	 Return: Only returns, with 1, if epoll cannot be set up or waited on.
+ *	 Method: The devices are held open and registered with epoll, edge
+ *			 triggered, for hangups and errors, not input: traffic says
+ *			 nothing about the settings, and a busy line would read them
+ *			 on every byte. tcgetattr() is only called for a device when
+ *			 epoll says something happened to it (a hangup, the driver
+ *			 going away), and for all of them every --interval seconds,
+ *			 since a settings change on its own wakes nothing. The full
+ *			 check is due at a fixed deadline, so events only shorten the
+ *			 wait for it, never put it off. A remote port (rfc2217://) is a
+ *			 socket with no line events of its own, so only the --interval
+ *			 check applies to it. A device that hangs up is closed and
+ *			 reopened on the next full check. A line is printed when a
+ *			 device drifts, or drifts differently; nothing while it stays
+ *			 the same.
+ */
+int run_watch(glob_t *devices, struct sttyl_delta *delta)
+{
+	struct epoll_event evs[64];
+	struct wdev_t *devs;
+	size_t i, ndevs = devices->gl_pathc;
+	long long deadline, left;
+	int ep, n, j;
+
+	if ( (ep = epoll_create1(EPOLL_CLOEXEC)) == -1 )
+	{
+		perror("cannot watch devices");
+		return 1;
+	}
+	if ( (devs = calloc(ndevs, sizeof(struct wdev_t))) == NULL )
+		fatal("out of memory for", "--watch");
+
+	for(i = 0; i < ndevs; i++)
+	{
+		devs[i].name = devices->gl_pathv[i];
+		devs[i].fd = -1;
+	}
+
+	for(;;)
+	{
+		for(i = 0; i < ndevs; i++)					//full check
+		{
+			if (devs[i].fd == -1 && watch_open(ep, devs, i) == -1)
+				continue;
+			check_drift(&devs[i], delta);
+		}
+		out_flush();
+		deadline = watch_clock() + interval * 1000LL;
+
+		//wait for activity, until the next full check is due
+		while( (left = deadline - watch_clock()) > 0 &&
+			   (n = epoll_wait(ep, evs, 64, left)) != 0 )
+		{
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				perror("waiting for devices");
+				return 1;
+			}
+
+			for(j = 0; j < n; j++)
+			{
+				struct wdev_t *d = &devs[evs[j].data.u32];
+
+				if (evs[j].events & (EPOLLHUP | EPOLLERR))
+				{
+					check_drift(d, delta);			//a hangup may reset it
+					sttyl_close(d->fd);				//also leaves the epoll
+					d->fd = -1;						//reopen at next check
+				}
+				else
+					check_drift(d, delta);
+			}
+			out_flush();
+		}
+	}
+}
+
+/*
+ *	watch_clock()
+ *	Purpose: Read the clock run_watch() keeps its deadline on.
+ *	 Return: CLOCK_MONOTONIC in milliseconds.
+ */
+long long watch_clock()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+}
+
+/*
+ *	watch_open()
+ *	Purpose: Open a device for run_watch() and add it to the epoll set.
+ *	  Input: ep, the epoll descriptor
+ *			 devs, the array of devices being watched
+ *			 i, the one to open; its fd is set on success
+ *	 Return: 0 on success. On error, -1; the error is reported the first
+ *			 time, not on every retry.
+ */
+int watch_open(int ep, struct wdev_t *devs, int i)
+{
+	struct epoll_event ev;
+	struct wdev_t *d = &devs[i];
+
+	d->fd = sttyl_open(d->name);					//local or remote
+
+	ev.events = EPOLLPRI | EPOLLRDHUP | EPOLLERR | EPOLLET;
+	ev.data.u32 = i;								//back to the device
+	if (d->fd != -1 && epoll_ctl(ep, EPOLL_CTL_ADD, d->fd, &ev) == 0)
+	{
+		d->down = NO;
+		return 0;
+	}
+
+	if (d->down == NO)								//report it once
+		tty_error(NULL, d->name, errno);
+	d->down = YES;
+	if (d->fd != -1)
+		sttyl_close(d->fd);
+	d->fd = -1;
+
+	return -1;
+}
+
+/*
+ *	check_drift()
+ *	Purpose: Read a device's settings and report if they have drifted.
+ *	  Input: d, the watched device
+ *			 delta, the expected settings
+ *	 Method: The delta is applied to a copy of the current settings; if
+ *			 that changes anything, the device has drifted. A report is only
+ *			 printed if the settings also differ from what was last seen,
+ *			 so a device that stays drifted is reported once. Coming back
+ *			 into line is reported too.
+ */
+void check_drift(struct wdev_t *d, struct sttyl_delta *delta)
+{
+	struct termios current, expected;
+
+	if (sttyl_get(d->fd, &current) == -1)
+		return;										//hangup: next full check
+
+	expected = current;
+	sttyl_apply_delta(delta, &expected);
+
+	if (sttyl_same(&current, &expected) == YES)	//as it should be
+	{
+		if (d->drifted == YES)
+			out_printf("%s: ok\n", d->name);
+		d->drifted = NO;
+	}
+	else if (d->drifted == NO || sttyl_same(&current, &d->last) == NO)
+	{
+		show_drift(d, &current, &expected);
+		d->drifted = YES;
+	}
+
+	d->last = current;
+	return;
+}
+
+/*
+ *	show_drift()
+ *	Purpose: Print one line saying how a device has drifted.
+ *	  Input: d, the watched device
+ *			 current, its settings now
+ *			 expected, the settings it should have
+ *	 Output: "name: drift:" and then what sttyl_format_diff() gives: the
+ *			 current value of each flag, char, and speed that is not as
+ *			 expected, e.g.
+ *			 "/dev/ttyS0: drift: echo -icanon erase = ^H; speed 9600"
+ */
+void show_drift(struct wdev_t *d, struct termios *current,
+				struct termios *expected)
+{
+	char line[OUTSIZE];
+
+	sttyl_format_diff(d->fd, current, expected, line, OUTSIZE);
+	out_printf("%s: drift:%s\n", d->name, line);	//cut short if huge
+	return;
+}
+
+/*
+ *	show_stats()
+ *	Purpose: Print the --stats counters to stderr.
+ *	 Output: The number of devices processed, and how many needed a
+ *			 tcsetattr() call and how many were already set.
+ */
+void show_stats()
+{
+	fprintf(stderr, "%s: %d devices, %d written, %d unchanged\n",
+			progname, stats.devices, stats.written, stats.skipped);
+	return;
+}
+
+/*
+ *	add_failure()
+ *	Purpose: Record a device that could not be configured.
+ *	  Input: name, the device; it is copied, as the caller's may be reused
+ *			 kind, the stage that failed, F_OPEN etc.
+ *	 Return: -1, for the caller to return.
+ *	   Note: Only called from the main thread.
+ */
+int add_failure(char *name, int kind)
+{
+	char **names = realloc(failed.names, (failed.count + 1) * sizeof(char *));
+
+	failed.kinds[kind]++;
+	if (names == NULL || (names[failed.count] = strdup(name)) == NULL)
+		fatal("out of memory recording failure of", name);
+	failed.names = names;
+	failed.count++;
+
+	return -1;
+}
+
+/*
+ *	show_failures()
+ *	Purpose: Print one summary of the devices that failed, when there was
+ *			 more than one device.
+ *	 Output: One line on stderr: how many failed, how many at each stage,
+ *			 and their names, so they can be retried on their own, e.g.
+ *			 "sttyl: 2 of 500 devices failed (open 1, apply 1): /dev/ttyS3
+ *			 /dev/ttyS9"
+ */
+void show_failures()
+{
+	int i, n = 0;
+
+	if (failed.count == 0 || stats.devices < 2)	//the error says it all
+		return;
+
+	fprintf(stderr, "%s: %d of %d devices failed (", progname, failed.count,
+			stats.devices);
+	for(i = 0; i < NFAIL; i++)
+		if (failed.kinds[i] > 0)
+			fprintf(stderr, "%s%s %d", n++ ? ", " : "", fail_names[i],
+					failed.kinds[i]);
+	fprintf(stderr, "):");
+	for(i = 0; i < failed.count; i++)
+		fprintf(stderr, " %s", failed.names[i]);
+	fprintf(stderr, "\n");
+
+	return;
+}
+
+/*
+ *	out_report()
+ *	Purpose: Add the report for one device to the report buffer.
+ *	  Input: name, the device name
+ *			 fd, the file descriptor of the tty
+ *			 info, the settings to show
+ *	 Method: sttyl_format() writes straight into the free end of the
+ *			 buffer, labelled with the device name if devices were named
+ *			 with -F, and with only the --fields asked for. If the report
+ *			 does not fit, the buffer is flushed and it is formatted again
+ *			 at the start.
+ *	 Return: 0, or -1 with errno set if the window size cannot be read;
+ *			 nothing is added then.
+ */
+int out_report(char *name, int fd, struct termios *info)
+{
+	int fmt = format | fields | (show_names == YES ? STTYL_LABEL : 0);
+	int n = sttyl_format(name, fd, info, fmt, out.buf + out.len,
+						 OUTSIZE - out.len);
+
+	if (n >= 0 && (size_t)n >= OUTSIZE - out.len)	//did not fit
+	{
+		out_flush();
+		if ( (n = sttyl_format(name, fd, info, fmt, out.buf, OUTSIZE))
+			 >= OUTSIZE )
+			n = OUTSIZE - 1;						//too big for any buffer
+	}
+
+	if (n == -1)
+		return -1;
+
+	out.len += n;
+	return 0;
+}
+
+/*
+ *	out_printf()
+ *	Purpose: Format output into the report buffer instead of stdout.
+ *	  Input: fmt, and any arguments, as printf()
+ *	 Method: The reports for all devices are built up in one static buffer
+ *			 and written with a single write() when it fills up or at exit,
+ *			 so showing hundreds of devices, or piping into a log collector,
+ *			 costs a few large writes instead of dozens of small ones each.
+ *			 If a piece does not fit, the buffer is flushed and the piece is
+ *			 formatted again at the start.
+ */
+void out_printf(char *fmt, ...)
+{
+	va_list ap;
+	size_t room = OUTSIZE - out.len;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(out.buf + out.len, room, fmt, ap);
+	va_end(ap);
+
+	if (n >= 0 && (size_t)n >= room)				//did not fit
+	{
+		out_flush();
+		va_start(ap, fmt);
+		n = vsnprintf(out.buf, OUTSIZE, fmt, ap);
+		va_end(ap);
+		if (n >= OUTSIZE)							//too big for any buffer
+			n = OUTSIZE - 1;
+	}
+
+	if (n > 0)
+		out.len += n;
+
+	return;
+}
+
+/*
+ *	out_flush()
+ *	Purpose: Write the report buffer to stdout and empty it.
+ *	 Errors: A failed write is reported on stderr and the output dropped;
+ *			 short writes and interrupted calls are retried.
+ */
+void out_flush()
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while(done < out.len)
+	{
+		if ( (n = write(STDOUT_FILENO, out.buf + done, out.len - done)) < 0 )
+		{
+			if (errno == EINTR)
+				continue;
+			perror("writing output");
+			break;
+		}
+		done += n;
+	}
+
+	out.len = 0;
+	return;
+}
+
+/*
+ *	fatal()
+ *	Purpose: Print message to stderr and exit.
+ *	  Input: err, the type of error that was encounters
+ *			 arg, the value of the argument that caused a problem
+ *	 Return: Exit with 1.
+ */
+void fatal(const char *err, const char *arg)
+{
+	fprintf(stderr, "%s: %s `%s'\n", progname, err, arg);
+	exit(1);
+}
+
+/*
+ *	load_profile()
+ *	Purpose: Add a named, precompiled profile to the delta.
+ *	  Input: name, the profile to use, e.g. "modem"
+ *			 delta, the delta to merge the profile into
+ *	 Method: The compiled profile file ($STTYL_PROFILES, or PROFILE_FILE) is
+ *			 mmap()ed the first time a profile is used, and stays mapped.
+ *			 The entries are sorted by name, so the profile is found with
+ *			 bsearch() and merged without any parsing. Each entry is checked
+ *			 once, when the file is mapped: its name must end inside name[],
+ *			 and its special chars fit c_cc[], so a damaged file cannot make
+ *			 bsearch() or sttyl_merge() go past the entry.
+ *	 Errors: If the file cannot be read, is not a profile file from this
+ *			 build, or has no such profile, fatal() is called and exit 1.
+ */
+void load_profile(char *name, struct sttyl_delta *delta)
+{
+	static const struct prof_head_t *head = NULL;	//the mapped file
+	static char *path;
+	const struct prof_t *entry;
+	struct stat st;
+	unsigned int i;
+	int fd, j;
+
+	if (head == NULL)
+	{
+		if ( (path = getenv("STTYL_PROFILES")) == NULL )
+			path = PROFILE_FILE;
+
+		if ( (fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1 )
+			fatal(strerror(errno), path);
+		if (st.st_size < (off_t)sizeof(struct prof_head_t))
+			fatal("not a compiled profile file", path);
+
+		head = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);									//mapping stays valid
+		if (head == MAP_FAILED)
+			fatal(strerror(errno), path);
+
+		if (memcmp(head->magic, PROFILE_MAGIC, sizeof(head->magic)) != 0 ||
+			head->size != sizeof(struct prof_t) ||
+			st.st_size < (off_t)(sizeof(struct prof_head_t) +
+								 (off_t)head->count * sizeof(struct prof_t)))
+			fatal("not a compiled profile file for this sttyl", path);
+
+		for(i = 0, entry = (const struct prof_t *)(head + 1); i < head->count;
+			i++, entry++)
+		{
+			if (memchr(entry->name, '\0', PROFILE_NAME) == NULL ||
+				entry->delta.ncc < 0 || entry->delta.ncc > NCCS)
+				fatal("not a compiled profile file for this sttyl", path);
+			for(j = 0; j < entry->delta.ncc; j++)
+				if (entry->delta.cc[j].index >= NCCS)
+					fatal("not a compiled profile file for this sttyl", path);
+		}
+	}
+
+	entry = bsearch(name, head + 1, head->count, sizeof(struct prof_t),
+					prof_cmp);
+	if (entry == NULL)
+		fatal("no such profile", name);
+
+	sttyl_merge(delta, &entry->delta);
+	return;
+}
+
+/*
+ *	compile_profiles()
+ *	Purpose: Build a compiled profile file from text definitions.
+ *	  Input: source, the text file. Each line is a profile name followed by
+ *			 settings, as they would be given on the command line, e.g.
+ *
+ *				modem	9600 cs8 -parenb hupcl crtscts
+ *
+ *			 Blank lines and lines starting with '#' are skipped. A line
+ *			 may be up to BUFSIZ - 2 characters long, and is an error if
+ *			 longer, rather than read as two.
+ *			 output, the file to write; it is replaced atomically.
+ *	 Return: 0 on success. On a bad line or a system call error, a
+ *			 message is output to stderr and exit 1.
+ *	   Note: Settings are parsed by get_option(), exactly as arguments are,
+ *			 so a profile always means the same as the same command line.
+ */
+int compile_profiles(char *source, char *output)
+{
+	struct prof_head_t head;
+	struct prof_t *profs = NULL;
+	char line[BUFSIZ], tmp[BUFSIZ], *args[BUFSIZ / 2], *save;
+	char where[BUFSIZ], *name = progname;
+	int count = 0, lineno = 0, i, fd;
+	FILE *fp;
+
+	if ( (fp = fopen(source, "r")) == NULL )
+		fatal(strerror(errno), source);
+
+	while(fgets(line, BUFSIZ, fp) != NULL)
+	{
+		int n = 0, c;
+
+		lineno++;
+		if (strchr(line, '\n') == NULL && (c = getc(fp)) != EOF)
+		{
+			ungetc(c, fp);							//not just the last line
+			snprintf(where, BUFSIZ, "%s: %s:%d", name, source, lineno);
+			progname = where;
+			snprintf(tmp, BUFSIZ, "%d characters", BUFSIZ - 2);
+			fatal("line longer than", tmp);
+		}
+		for(args[n] = strtok_r(line, " \t\n", &save); args[n] != NULL;
+			args[n] = strtok_r(NULL, " \t\n", &save))
+			if (++n == BUFSIZ / 2 - 1)
+				break;
+		args[n] = NULL;
+
+		if (n == 0 || args[0][0] == '#')			//blank or comment
+			continue;
+
+		//errors name the line: "sttyl: file:3: illegal argument `foo'"
+		snprintf(where, BUFSIZ, "%s: %s:%d", name, source, lineno);
+		progname = where;
+
+		if (strlen(args[0]) >= PROFILE_NAME)
+			fatal("profile name too long", args[0]);
+		for(i = 0; i < count; i++)
+			if (strcmp(profs[i].name, args[0]) == 0)
+				fatal("duplicate profile", args[0]);
+
+		if ( (profs = realloc(profs, (count + 1) * sizeof(struct prof_t)))
+			 == NULL )
+			fatal("out of memory compiling", args[0]);
+
+		memset(&profs[count], 0, sizeof(struct prof_t));
+		strcpy(profs[count].name, args[0]);
+		sttyl_init(&profs[count].delta);
+		for(i = 1; args[i] != NULL; i++)			//same as the command line
+			i += get_option(&args[i], &profs[count].delta);
+		count++;
+	}
+	fclose(fp);
+	progname = name;
+
+	qsort(profs, count, sizeof(struct prof_t), prof_cmp);
+
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, PROFILE_MAGIC, sizeof(head.magic));
+	head.count = count;
+	head.size = sizeof(struct prof_t);
+
+	snprintf(tmp, BUFSIZ, "%s.tmp", output);		//write, then rename
+	if ( (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ||
+		 write(fd, &head, sizeof(head)) != sizeof(head) ||
+		 write(fd, profs, count * sizeof(struct prof_t))
+			!= (ssize_t)(count * sizeof(struct prof_t)) ||
+		 close(fd) == -1 || rename(tmp, output) == -1 )
+		fatal(strerror(errno), output);
+
+	free(profs);
+	return 0;
+}
+
+/*
+ *	prof_cmp()
+ *	Purpose: Comparison function for bsearch() and qsort() on profiles.
+ *	  Input: a, the name being searched for, or a profile
+ *			 b, a profile
+ *	 Return: <0, 0, or >0, as strcmp().
+ *	   Note: The name is the first member of struct prof_t, so a profile
+ *			 can be used as the key too.
+ */
+int prof_cmp(const void *a, const void *b)
+{
+	return strcmp((const char *)a, ((const struct prof_t *)b)->name);
+}
+
+/*
+ *	run_snapshot()
+ *	Purpose: Save the state of every device to a snapshot file.
+ *	  Input: devices, the device list; if empty, stdin is saved
+ *			 path, the file to write, replaced atomically; "-" for stdout
+ *	 Return: 0. A device that cannot be read is left out, and recorded for
+ *			 show_failures(). If the file cannot be written, fatal() is
+ *			 called and exit 1.
+ *	 Method: The records are built up in memory and written with the
+ *			 header in two write()s, so a fleet costs a few bytes per port
+ *			 rather than a text report each.
+ */
+int run_snapshot(glob_t *devices, char *path)
+{
+	struct snap_head_t head;
+	struct sttyl_trace trace;
+	char *recs = NULL, tmp[PATH_MAX];
+	size_t len = 0, i;
+	int fd;
+
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, SNAP_MAGIC, sizeof(head.magic));
+	head.size = sizeof(struct sttyl_state);
+
+	if (devices->gl_pathc == 0)						//no -F: just stdin
+		head.count += snap_device("stdin", 0, &recs, &len) == 0;
+
+	for(i = 0; i < devices->gl_pathc; i++)
+	{
+		char *dev = devices->gl_pathv[i];
+
+		sttyl_trace_begin();
+		if ( (fd = sttyl_open(dev)) == -1 )
+		{
+			tty_error(NULL, dev, errno);			//report device, go on
+			stats.devices++;
+			add_failure(dev, F_OPEN);
+		}
+		else
+		{
+			head.count += snap_device(dev, fd, &recs, &len) == 0;
+			sttyl_close(fd);
+		}
+		sttyl_trace_end(&trace);
+		trace_report(dev, &trace);
+	}
+
+	snprintf(tmp, PATH_MAX, "%s.tmp", path);		//write, then rename
+	if (strcmp(path, "-") == 0)
+		fd = STDOUT_FILENO;
+	else
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ( fd == -1 || write(fd, &head, sizeof(head)) != sizeof(head) ||
+		 (len > 0 && write(fd, recs, len) != (ssize_t)len) )
+		fatal(strerror(errno), path);
+	if ( fd != STDOUT_FILENO && (close(fd) == -1 || rename(tmp, path) == -1) )
+		fatal(strerror(errno), path);
+
+	free(recs);
+	return 0;
+}
+
+/*
+ *	snap_device()
+ *	Purpose: Add the record for one open tty to the snapshot.
+ *	  Input: name, the device name, as stored and used in messages
+ *			 fd, the open file descriptor for the device
+ *			 recs, len, the records so far; grown with realloc()
+ *	 Return: 0, or -1 if the settings cannot be read.
+ *	 Errors: On failure, a message is output to stderr, and the device is
+ *			 recorded for show_failures().
+ */
+int snap_device(char *name, int fd, char **recs, size_t *len)
+{
+	struct termios info;
+	struct sttyl_state state;
+	unsigned short n = strlen(name);				//names are < PATH_MAX
+	char *p;
+
+	stats.devices++;
+
+	if ( sttyl_get(fd, &info) == -1 )
+	{
+		tty_error("cannot get tty info for", name, errno);
+		return add_failure(name, F_READ);
+	}
+	sttyl_pack(&info, &state);
+
+	if ( (p = realloc(*recs, *len + sizeof(n) + n + sizeof(state))) == NULL )
+		fatal("out of memory saving", name);
+	memcpy(p + *len, &n, sizeof(n));
+	memcpy(p + *len + sizeof(n), name, n);
+	memcpy(p + *len + sizeof(n) + n, &state, sizeof(state));
+	*recs = p;
+	*len += sizeof(n) + n + sizeof(state);
+
+	return 0;
+}
+
+/*
+ *	run_diff()
+ *	Purpose: Compare every device in a snapshot file with its state now.
+ *	  Input: path, the file written by --snapshot
+ *	 Return: 0. A device that cannot be read is recorded for
+ *			 show_failures().
+ *	 Output: One line per device that differs, from diff_device(); nothing
+ *			 for one that is the same.
+ *	 Errors: If the file cannot be read, is not a snapshot from this build,
+ *			 or is cut short, fatal() is called and exit 1.
+ *	 Method: The file is mmap()ed, as a profile file is, and the records
+ *			 are walked in order; each device is opened once.
+ */
+int run_diff(char *path)
+{
+	const struct snap_head_t *head;
+	const char *p, *end;
+	struct stat st;
+	struct sttyl_trace trace;
+	unsigned int i;
+	int fd;
+
+	if ( (fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1 )
+		fatal(strerror(errno), path);
+	if (st.st_size < (off_t)sizeof(struct snap_head_t))
+		fatal("not a snapshot file", path);
+
+	head = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);										//mapping stays valid
+	if (head == MAP_FAILED)
+		fatal(strerror(errno), path);
+	if (memcmp(head->magic, SNAP_MAGIC, sizeof(head->magic)) != 0 ||
+		head->size != sizeof(struct sttyl_state))
+		fatal("not a snapshot file for this sttyl", path);
+
+	p = (const char *)(head + 1);
+	end = (const char *)head + st.st_size;
+	for(i = 0; i < head->count; i++)
+	{
+		char name[PATH_MAX];
+		struct sttyl_state state;
+		unsigned short n;
+
+		if ((size_t)(end - p) < sizeof(n))
+			break;
+		memcpy(&n, p, sizeof(n));
+		if (n >= PATH_MAX ||
+			(size_t)(end - p) < sizeof(n) + n + sizeof(state))
+			break;
+		memcpy(name, p + sizeof(n), n);				//copy out: unaligned
+		name[n] = '\0';
+		memcpy(&state, p + sizeof(n) + n, sizeof(state));
+		p += sizeof(n) + n + sizeof(state);
+
+		sttyl_trace_begin();
+		diff_device(name, &state);
+		sttyl_trace_end(&trace);
+		trace_report(name, &trace);
+	}
+	if (i < head->count)
+		fatal("snapshot file cut short", path);
+
+	munmap((void *)head, st.st_size);
+	return 0;
+}
+
+/*
+ *	diff_device()
+ *	Purpose: Compare one device with its state in a snapshot.
+ *	  Input: name, the device name from the snapshot; "stdin" is fd 0
+ *			 state, its saved state
+ *	 Return: 0, or -1 if the device failed.
+ *	 Output: "name: values", where values are as for --watch: the live value
+ *			 of each flag, char, and speed that is not as saved, by its
+ *			 table[] name, e.g. "/dev/ttyS0: -echo erase = ^H; speed 9600".
+ *	 Errors: On failure, a message is output to stderr, and the device is
+ *			 recorded for show_failures().
+ */
+int diff_device(char *name, struct sttyl_state *state)
+{
+	struct termios current, expected;
+	char line[OUTSIZE];
+	int fd = 0, result = 0;
+
+	stats.devices++;
+
+	if ( strcmp(name, "stdin") != 0 && (fd = sttyl_open(name)) == -1 )
+	{
+		tty_error(NULL, name, errno);
+		return add_failure(name, F_OPEN);
+	}
+
+	if ( sttyl_get(fd, &current) == -1 )
+	{
+		tty_error("cannot get tty info for", name, errno);
+		result = add_failure(name, F_READ);
+	}
+	else
+	{
+		expected = current;							//c_line etc. as they are
+		sttyl_unpack(state, &expected);
+		if (sttyl_format_diff(fd, &current, &expected, line, OUTSIZE) > 0)
+			out_printf("%s:%s\n", name, line);
+	}
+
+	if (fd != 0)
+		sttyl_close(fd);
+	return result;
+}
+
+/*
+ *	get_option()
+ *	Purpose: Parse one setting into the delta, as sttyl_parse().
+ *	  Input: av, the argument list, positioned at the setting
+ *			 delta, the delta to record the change in
+ *	 Return: The number of extra arguments used. If the setting is not
+ *			 valid, fatal() is called to print the error and exit 1.
+ */
+int get_option(char **av, struct sttyl_delta *delta)
+{
+	struct sttyl_err err;
+	int n;
+
+	if ( (n = sttyl_parse(av, delta, &err)) == -1 )
+		fatal(err.msg, err.arg);
+
+	return n;
+}
+
+/*
+ *	get_when()
+ *	Purpose: Convert the argument to --when into a tcsetattr() action.
+ *	  Input: arg, one of "now", "drain" (after queued output is sent), or
+ *			 "flush" (after output is sent, discarding unread input)
+ *	 Return: TCSANOW, TCSADRAIN, or TCSAFLUSH, or -1 for anything else.
+ */
+int get_when(char *arg)
+{
+	if (strcmp(arg, "now") == 0)
+		return TCSANOW;
+	if (strcmp(arg, "drain") == 0)
+		return TCSADRAIN;
+	if (strcmp(arg, "flush") == 0)
+		return TCSAFLUSH;
+	return -1;
+}
+
+/*
+ *	get_flush()
+ *	Purpose: Convert the argument to --flush into a tcflush() queue.
+ *	  Input: arg, one of "in" (unread input), "out" (unsent output), or
+ *			 "both"
+ *	 Return: TCIFLUSH, TCOFLUSH, or TCIOFLUSH, or -1 for anything else.
+ */
+int get_flush(char *arg)
+{
+	if (strcmp(arg, "in") == 0)
+		return TCIFLUSH;
+	if (strcmp(arg, "out") == 0)
+		return TCOFLUSH;
+	if (strcmp(arg, "both") == 0)
+		return TCIOFLUSH;
+	return -1;
+}
+
+/*
+ *	get_fields()
+ *	Purpose: Convert the argument to --fields into STTYL_F_ bits.
+ *	  Input: arg, a comma-separated list of "speed", "size", "serial",
+ *			 "queue", "cchars", and "flags", e.g. "flags,cchars"
+ *	 Return: The bits, or'ed together; the report shows only those, in its
+ *			 usual order. An unknown or empty name calls fatal().
+ */
+int get_fields(char *arg)
+{
+	static const struct {char *name; int bit; } names[] = {
+		{"speed", STTYL_F_SPEED}, {"size", STTYL_F_SIZE},
+		{"cchars", STTYL_F_CCHARS}, {"flags", STTYL_F_FLAGS},
+		{"serial", STTYL_F_SERIAL}, {"queue", STTYL_F_QUEUE}, {NULL, 0}
+	};
+	char *p = arg;
+	int bits = 0, i;
+	size_t len;
+
+	do
+	{
+		len = strcspn(p, ",");
+		for(i = 0; names[i].name != NULL; i++)
+			if (strlen(names[i].name) == len
+				&& strncmp(p, names[i].name, len) == 0)
+				break;
+		if (names[i].name == NULL)
+			fatal("invalid argument", arg);
+		bits |= names[i].bit;
+		p += len;
+	} while (*p++ == ',');
+
+	return bits;
+}
+
+/*
+ *	get_count()
+ *	Purpose: Convert the argument to -j or --interval into a number.
+ *	  Input: arg, the argument, in decimal
+ *			 max, the largest value allowed
+ *	 Return: The number, from 1 to max. Anything else, including signs,
+ *			 spaces, or trailing characters, calls fatal().
+ */
+int get_count(char *arg, int max)
+{
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(arg, &end, 10);
+	if (!isdigit((unsigned char)arg[0]) || *end != '\0' || errno == ERANGE ||
+		n < 1 || n > max)
+		fatal("invalid argument", arg);
+	return (int)n;
+}
+
+/*
+ *	tty_error()
+ *	Purpose: Report a failed call on a tty, in the style of perror().
+ *	  Input: step, what failed, e.g. "Setting attributes for"
+ *			 name, the device name
+ *			 err, the errno value from the failed call
+ *	 Output: "step name: error message" on stderr. A NULL step means the
+ *			 device could not be opened, reported as fatal() would.
+ */
+void tty_error(char *step, char *name, int err)
+{
+	if (step == NULL)
+		fprintf(stderr, "%s: %s `%s'\n", progname, strerror(err), name);
+	else
+		fprintf(stderr, "%s %s: %s\n", step, name, strerror(err));
+	return;
+}
+
+/*
+ *	trace_report()
+ *	Purpose: Print the trace of one device, and add it to the totals for
+ *			 trace_summary().
+ *	  Input: name, the device name
+ *			 t, its trace
+ *	 Output: With --trace, one line on stderr with the time spent in each
+ *			 kind of call, and how many there were if more than one, e.g.
+ *			 "sttyl: trace /dev/ttyS0: open 12.0us, tcgetattr 3.1us,
+ *			 tcsetattr 30.2us, close 2.9us; total 51.3us"
+ *	   Note: Only called from the main thread, so the totals need no lock.
+ */
+void trace_report(char *name, struct sttyl_trace *t)
+{
+	int i, n = 0;
+
+	if (tracing == NO)
+		return;
+
+	fprintf(stderr, "%s: trace %s:", progname, name);
+	for(i = 0; i < STTYL_NTRACE; i++)
+	{
+		if (t->calls[i] == 0)
+			continue;
+		fprintf(stderr, "%s %s %.1fus", n++ ? "," : "", sttyl_trace_name(i),
+				t->ns[i] / 1000);
+		if (t->calls[i] > 1)
+			fprintf(stderr, " (%d)", t->calls[i]);
+
+		traced.sum.calls[i] += t->calls[i];			//for trace_summary()
+		traced.sum.ns[i] += t->ns[i];
+		if (t->max[i] > traced.sum.max[i])
+			traced.sum.max[i] = t->max[i];
+	}
+	fprintf(stderr, "; total %.1fus\n", t->total / 1000);
+
+	traced.sum.total += t->total;
+	traced.devices++;
+	if (t->total > traced.slowest_ns)
+	{
+		traced.slowest_ns = t->total;
+		snprintf(traced.slowest, PATH_MAX, "%s", name);	//name may be reused
+	}
+	return;
+}
+
+/*
+ *	trace_summary()
+ *	Purpose: Print the totals over all devices, for --trace with more than
+ *			 one device.
+ *	 Output: One line on stderr: per kind of call, the total time, the
+ *			 number of calls, and the slowest one; then the total for all
+ *			 devices and the slowest device, e.g.
+ *			 "sttyl: trace 8 devices: open 96.0us (8, max 30.2us), ...;
+ *			 total 410.5us, slowest /dev/ttyUSB3 70.1us"
+ *	   Note: With -j the devices overlap, so the total is more than the
+ *			 time the run took.
+ */
+void trace_summary()
+{
+	int i, n = 0;
+
+	if (tracing == NO || traced.devices < 2)
+		return;
+
+	fprintf(stderr, "%s: trace %d devices:", progname, traced.devices);
+	for(i = 0; i < STTYL_NTRACE; i++)
+	{
+		if (traced.sum.calls[i] == 0)
+			continue;
+		fprintf(stderr, "%s %s %.1fus (%d, max %.1fus)", n++ ? "," : "",
+				sttyl_trace_name(i), traced.sum.ns[i] / 1000,
+				traced.sum.calls[i], traced.sum.max[i] / 1000);
+	}
+	fprintf(stderr, "; total %.1fus, slowest %s %.1fus\n",
+			traced.sum.total / 1000, traced.slowest, traced.slowest_ns / 1000);
+	return;
 }
@@ -0,0 +1,154 @@
+/*
+ * ==========================
+ *   FILE: ./sttyl.h
+ * ==========================
+ * Purpose: The C interface to libsttyl, the library behind sttyl, for
+ *			programs that set up ttys themselves instead of running sttyl.
+ *
+ * Outline: Settings are parsed once, from the same words sttyl takes on
+ *			its command line, into a delta: a reusable set of changes. A
+ *			delta is applied to any number of ttys, each with one
+ *			tcgetattr() and, only if something changes, one tcsetattr().
+ *			A snapshot is a delta that puts back every setting a tty has
+ *			now, so restoring is just applying it. Reports are formatted
+ *			into the caller's buffer, in any of sttyl's formats.
+ *
+ *				struct sttyl_delta d, saved;
+ *				struct sttyl_err err;
+ *				char *args[] = {"115200", "-echo", "erase", "x", NULL};
+ *				char **av, *step;
+ *				int n;
+ *
+ *				sttyl_init(&d);
+ *				for(av = args; *av; av++)
+ *					if ( (n = sttyl_parse(av, &d, &err)) == -1 )
+ *						... err.msg, err.arg ...
+ *					else
+ *						av += n;
+ *				sttyl_snapshot(fd, &saved, &step);
+ *				if (sttyl_apply(fd, &d, &step) == -1)
+ *					... step, errno ...
+ *				...
+ *				sttyl_restore(fd, &saved, &step);
+ *
+ *	 Errors: Nothing in the library prints or exits. Parsing fills in a
+ *			 struct sttyl_err; calls on a tty return -1 with errno set and
+ *			 a description of the call that failed, e.g. "Setting attributes
+ *			 for", to be followed by the device name. All functions can be
+ *			 called from several threads, each on its own ttys and deltas.
+ */
+#ifndef STTYL_H
+#define STTYL_H
+
+#include	<stddef.h>
+#include	<termios.h>
+
+/*
+ * A delta has a mask of bits to set and a mask of bits to clear for each of
+ * the four flag words (c_iflag, c_oflag, c_cflag, c_lflag, in that order),
+ * a short list of c_cc[] patches, and the speeds. Settings outside termios
+ * come after: the line discipline (TIOCSETD), and the low_latency flag and
+ * transmit FIFO size of a serial port (TIOCSSERIAL). It also says how to
+ * write it: the tcsetattr() action, whether to read the settings back and
+ * roll back if they did not all take, and what to do with the queues
+ * first: wait for the output to drain (tcdrain()), then discard either or
+ * both (tcflush()). Treat the fields as private; a delta is made by
+ * sttyl_init() and sttyl_parse().
+ */
+#define STTYL_NWORDS 4
+struct sttyl_cc {cc_t index; cc_t value; };
+struct sttyl_delta {tcflag_t set[STTYL_NWORDS];
+					tcflag_t clear[STTYL_NWORDS];
+					int ncc; struct sttyl_cc cc[NCCS];
+					int ispeed; int ospeed;		//rates, -1 if unchanged
+					int line;					//-1 if unchanged, as are:
+					int low_latency; int xmit_fifo;
+					int when; int verify;		//TCSANOW etc., 1 to verify
+					int flush; int drain; };	//-1 or TCIFLUSH etc.; 1 drains
+
+/*
+ * A state is the settings of a tty as -g prints them, in binary: the four
+ * flag words, in the same order as a delta's, then every c_cc[] entry. It
+ * is a plain struct, so it can be written to a file and read back by the
+ * same build.
+ */
+struct sttyl_state {tcflag_t words[STTYL_NWORDS]; cc_t cc[NCCS]; };
+
+/* why sttyl_parse() failed, as "msg `arg'" */
+struct sttyl_err {const char *msg; const char *arg; };
+
+/* sttyl_lookup() kinds of option */
+#define STTYL_FLAG		1
+#define STTYL_CCHAR		2
+#define STTYL_ISPEED	3
+#define STTYL_OSPEED	4
+#define STTYL_COMBO		5			//several settings at once, e.g. raw
+#define STTYL_LINE		6			//line discipline
+#define STTYL_LOWLAT	7			//serial low_latency flag
+#define STTYL_FIFO		8			//serial xmit_fifo_size
+
+/*
+ * sttyl_format() formats; STTYL_LABEL may be or-ed in to name the device,
+ * and any of the fields to show only those (none means the usual ones)
+ */
+#define STTYL_HUMAN		0			//as sttyl with no arguments
+#define STTYL_SAVE		1			//as sttyl -g
+#define STTYL_JSON		2			//as sttyl --json
+#define STTYL_LABEL		0x100
+#define STTYL_F_SPEED	0x200		//the speeds
+#define STTYL_F_SIZE	0x400		//rows and cols, from TIOCGWINSZ
+#define STTYL_F_CCHARS	0x800		//the special characters
+#define STTYL_F_FLAGS	0x1000		//the flags
+#define STTYL_F_SERIAL	0x2000		//line discipline, serial port options
+#define STTYL_F_QUEUE	0x4000		//bytes queued, from FIONREAD, TIOCOUTQ
+#define STTYL_F_ALL		0x7e00
+
+/*
+ * Tracing: when it is on, every call the library makes on a tty is timed,
+ * into a trace kept per thread. The kinds of call are counted separately.
+ */
+#define STTYL_T_OPEN	0
+#define STTYL_T_GETATTR	1
+#define STTYL_T_SETATTR	2
+#define STTYL_T_WINSIZE	3
+#define STTYL_T_IOCTL	4
+#define STTYL_T_CLOSE	5
+#define STTYL_NTRACE	6
+struct sttyl_trace {double start; double total; int calls[STTYL_NTRACE];
+					double ns[STTYL_NTRACE]; double max[STTYL_NTRACE]; };
+
+/* DELTAS */
+void sttyl_init(struct sttyl_delta *);
+int sttyl_parse(char **, struct sttyl_delta *, struct sttyl_err *);
+void sttyl_merge(struct sttyl_delta *, const struct sttyl_delta *);
+int sttyl_lookup(const char *);
+const char * sttyl_option_name(int);
+
+/* APPLYING */
+void sttyl_apply_delta(const struct sttyl_delta *, struct termios *);
+int sttyl_apply(int, const struct sttyl_delta *, char **);
+int sttyl_apply_from(int, const struct sttyl_delta *, struct termios *,
+					 char **);
+int sttyl_apply_path(const char *, const struct sttyl_delta *, char **);
+int sttyl_snapshot(int, struct sttyl_delta *, char **);
+int sttyl_restore(int, const struct sttyl_delta *, char **);
+int sttyl_same(const struct termios *, const struct termios *);
+void sttyl_pack(const struct termios *, struct sttyl_state *);
+void sttyl_unpack(const struct sttyl_state *, struct termios *);
+
+/* FORMATTING */
+int sttyl_format(const char *, int, const struct termios *, int, char *,
+				 size_t);
+int sttyl_format_diff(int, const struct termios *, const struct termios *,
+					  char *, size_t);
+
+/* TTY CALLS AND TRACING */
+int sttyl_open(const char *);
+int sttyl_close(int);
+int sttyl_get(int, struct termios *);
+void sttyl_trace(int);
+void sttyl_trace_begin();
+void sttyl_trace_end(struct sttyl_trace *);
+const char * sttyl_trace_name(int);
+
+#endif